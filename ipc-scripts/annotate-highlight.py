@@ -0,0 +1,44 @@
+#!/usr/bin/python3
+
+from wayfire import WayfireSocket
+import sys
+
+# Draw a box around each view with the given app-id, with an arrow pointing
+# at it, in a single annotate/draw call. Run with --clear to remove them.
+
+if len(sys.argv) < 2:
+    print(f"Usage: {sys.argv[0]} <app_id> | --clear")
+    exit(1)
+
+sock = WayfireSocket()
+
+if sys.argv[1] == "--clear":
+    response = sock.send_json({"method": "annotate/clear", "data": {"tag": "highlight"}})
+    if response.get("result") != "ok":
+        print(response.get("error", response))
+        exit(-1)
+    exit(0)
+
+primitives = {}
+for view in sock.list_views():
+    if view["app-id"] != sys.argv[1] or not view["mapped"]:
+        continue
+
+    g = view["geometry"]
+    output = view["output-id"]
+    primitives.setdefault(output, []).extend([
+        {"type": "rect", "x": g["x"] - 4, "y": g["y"] - 4,
+         "width": g["width"] + 8, "height": g["height"] + 8,
+         "color": "#FFD000FF", "line-width": 6},
+        {"type": "polyline", "points": [[g["x"] - 80, g["y"] - 80], [g["x"] - 10, g["y"] - 10],
+                                        [g["x"] - 10, g["y"] - 40], [g["x"] - 10, g["y"] - 10],
+                                        [g["x"] - 40, g["y"] - 10]],
+         "color": "#FFD000FF", "line-width": 4},
+    ])
+
+for output, batch in primitives.items():
+    response = sock.send_json({"method": "annotate/draw",
+                               "data": {"output-id": output, "tag": "highlight", "primitives": batch}})
+    if response.get("result") != "ok":
+        print(response.get("error", response))
+        exit(-1)
@@ -0,0 +1,19 @@
+#!/usr/bin/python3
+
+from wayfire import WayfireSocket
+import sys
+
+# Undo or redo the last annotation change on the focused output.
+# Usage: annotate-undo.py [undo|redo]
+
+sock = WayfireSocket()
+
+action = sys.argv[1] if len(sys.argv) > 1 else "undo"
+if action not in ("undo", "redo"):
+    print("Usage: annotate-undo.py [undo|redo]")
+    exit(-1)
+
+response = sock.send_json({"method": "annotate/" + action, "data": {}})
+if response.get("result") != "ok":
+    print(response.get("error", response))
+    exit(-1)
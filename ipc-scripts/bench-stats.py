@@ -0,0 +1,23 @@
+#!/usr/bin/python3
+
+from wayfire import WayfireSocket
+import json
+import sys
+
+# Print the bench frame statistics of all outputs. With --watch N, keep
+# printing a summary every N frames instead.
+
+sock = WayfireSocket()
+
+if len(sys.argv) == 3 and sys.argv[1] == "--watch":
+    sock.send_json({"method": "bench/watch", "data": {"frames": int(sys.argv[2])}})
+    while True:
+        event = sock.read_next_event()
+        if event.get("event") == "bench-stats":
+            print(json.dumps(event["output"]))
+elif len(sys.argv) == 1:
+    response = sock.send_json({"method": "bench/get-stats", "data": {}})
+    print(json.dumps(response["outputs"], indent=4))
+else:
+    print(f"Usage: {sys.argv[0]} [--watch <frames>]")
+    exit(-1)
@@ -0,0 +1,21 @@
+#!/usr/bin/python3
+
+from wayfire import WayfireSocket
+import sys
+
+# Print the most frequently damaged tiles of each output, while showrepaint
+# is active in heatmap mode. Optional argument: number of tiles to print.
+
+sock = WayfireSocket()
+
+count = int(sys.argv[1]) if len(sys.argv) > 1 else 10
+response = sock.send_json({"method": "showrepaint/heatmap", "data": {"count": count}})
+for output in response["outputs"]:
+    if not output["active"]:
+        print(f"{output['output-name']}: heatmap not active")
+        continue
+
+    print(f"{output['output-name']}:")
+    for spot in output["hotspots"]:
+        print(f"  {spot['width']}x{spot['height']}+{spot['x']}+{spot['y']}: "
+              f"{spot['damage-per-second']:.1f} damaged frames/s")
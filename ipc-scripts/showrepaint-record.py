@@ -0,0 +1,29 @@
+#!/usr/bin/python3
+
+from wayfire import WayfireSocket
+import sys
+
+# Start or stop recording the damage of all outputs. The recordings can be
+# inspected with wf-showrepaint-analyze.
+# Usage: showrepaint-record.py start [file] | stop
+
+sock = WayfireSocket()
+
+if len(sys.argv) < 2 or sys.argv[1] not in ("start", "stop"):
+    print(f"Usage: {sys.argv[0]} start [file] | stop")
+    sys.exit(1)
+
+data = {"action": sys.argv[1]}
+if len(sys.argv) > 2:
+    data["file"] = sys.argv[2]
+
+response = sock.send_json({"method": "showrepaint/record", "data": data})
+if response.get("result") != "ok":
+    print(response.get("error", response))
+    exit(-1)
+
+for output in response["outputs"]:
+    if sys.argv[1] == "start":
+        print(f"{output['output-name']}: recording to {output['file']}")
+    else:
+        print(f"{output['output-name']}: stopped")
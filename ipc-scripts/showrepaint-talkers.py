@@ -0,0 +1,21 @@
+#!/usr/bin/python3
+
+from wayfire import WayfireSocket
+import sys
+
+# Print the views which committed the most damage recently. Requires the
+# showrepaint attribution option. Optional argument: number of views.
+
+sock = WayfireSocket()
+
+count = int(sys.argv[1]) if len(sys.argv) > 1 else 10
+response = sock.send_json({"method": "showrepaint/damage-talkers", "data": {"count": count}})
+if response.get("result") != "ok":
+    print(response.get("error", response))
+    exit(-1)
+
+print(f"Damage over the last {response['window-ms']} ms:")
+for talker in response["talkers"]:
+    print(f"  {talker['view-id']:>5} {talker['app-id']:<24} "
+          f"{talker['pixels-per-second'] / 1e6:8.2f} Mpx/s "
+          f"{talker['commits-per-second']:6.1f} commits/s  {talker['title']}")
@@ -23,9 +23,26 @@
  */
 
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 #include <cairo.h>
 #include <wayfire/workspace-set.hpp> // IWYU pragma: keep
+#include "wayfire/core.hpp"
+#include "wayfire/config/types.hpp"
 #include "wayfire/geometry.hpp"
 #include "wayfire/opengl.hpp"
 #include "wayfire/region.hpp"
@@ -40,6 +57,9 @@
 #include "wayfire/per-output-plugin.hpp"
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/plugins/common/input-grab.hpp"
+#include "wayfire/plugins/common/shared-core-data.hpp"
+#include "wayfire/plugins/ipc/ipc-helpers.hpp"
+#include "wayfire/plugins/ipc/ipc-method-repository.hpp"
 
 enum annotate_draw_method
 {
@@ -47,20 +67,1734 @@ enum annotate_draw_method
     ANNOTATE_METHOD_LINE,
     ANNOTATE_METHOD_RECTANGLE,
     ANNOTATE_METHOD_CIRCLE,
+    /* Only drawn over IPC */
+    ANNOTATE_METHOD_POLYLINE,
 };
 
+enum anno_raster_job_type
+{
+    ANNOTATE_JOB_DRAW,
+    ANNOTATE_JOB_RELEASE,
+};
+
+enum anno_history_action
+{
+    ANNOTATE_HISTORY_ADD,
+    ANNOTATE_HISTORY_CLEAR,
+    ANNOTATE_HISTORY_REMOVE,
+};
+
+/* Size in pixels of the square tiles a drawing is split into */
+#define ANNOTATE_TILE_SIZE 256
+
 struct simple_texture_t
 {
-    GLuint tex = -1;
-    int width  = 0;
-    int height = 0;
-};
+    GLuint tex = -1;
+    int width  = 0;
+    int height = 0;
+};
+
+/*
+ * A stroke is a freehand polyline, or a shape defined by two points: the end
+ * points of a line, opposite corners of a rectangle, or the center of a
+ * circle and a point on it.
+ */
+struct anno_stroke_t
+{
+    annotate_draw_method method;
+    float width;
+    wf::color_t color;
+    /* Range of the points of the stroke in the point buffer */
+    uint32_t first_point;
+    uint32_t point_count;
+    /* See anno_tag_registry_t, 0 for strokes without a tag */
+    uint32_t tag;
+};
+
+/*
+ * Tags of strokes drawn over IPC. Strokes only carry the id of their tag,
+ * and every stroke in a stroke store holds a reference to it, so that the id
+ * is freed along with the last stroke of the tag. Id 0 is the empty tag,
+ * which is never freed. Only used on the main thread.
+ */
+struct anno_tag_registry_t
+{
+    std::unordered_map<std::string, uint32_t> ids;
+    /* Indexed by id */
+    std::vector<std::string> names = {""};
+    std::vector<uint32_t> refs     = {0};
+    std::vector<uint32_t> free_ids;
+
+    /* Takes a reference to a tag, adding it if no stroke has it */
+    uint32_t ref(const std::string& tag)
+    {
+        if (tag.empty())
+        {
+            return 0;
+        }
+
+        auto it = ids.find(tag);
+        if (it != ids.end())
+        {
+            refs[it->second]++;
+            return it->second;
+        }
+
+        uint32_t id;
+        if (free_ids.empty())
+        {
+            id = names.size();
+            names.push_back(tag);
+            refs.push_back(1);
+        } else
+        {
+            id = free_ids.back();
+            free_ids.pop_back();
+            names[id] = tag;
+            refs[id]  = 1;
+        }
+
+        ids.emplace(tag, id);
+        return id;
+    }
+
+    void ref(uint32_t id)
+    {
+        if (id != 0)
+        {
+            refs[id]++;
+        }
+    }
+
+    void unref(uint32_t id)
+    {
+        if ((id != 0) && (--refs[id] == 0))
+        {
+            ids.erase(names[id]);
+            names[id].clear();
+            free_ids.push_back(id);
+        }
+    }
+
+    /* The id of a tag, if any stroke has it */
+    std::optional<uint32_t> find(const std::string& tag) const
+    {
+        if (tag.empty())
+        {
+            return 0;
+        }
+
+        auto it = ids.find(tag);
+        if (it == ids.end())
+        {
+            return {};
+        }
+
+        return it->second;
+    }
+
+    const std::string& name(uint32_t id) const
+    {
+        return names[id];
+    }
+};
+
+static anno_tag_registry_t& anno_tags()
+{
+    static anno_tag_registry_t tags;
+    return tags;
+}
+
+/*
+ * Annotations kept as vector data, so that they can be rasterized again at
+ * any size and scale. The points of all strokes share one buffer, with
+ * separate arrays for the x and y coordinates.
+ */
+struct anno_stroke_store_t
+{
+    std::vector<float> x, y;
+    std::vector<anno_stroke_t> strokes;
+
+    anno_stroke_store_t() = default;
+
+    anno_stroke_store_t(const anno_stroke_store_t& other) :
+        x(other.x), y(other.y), strokes(other.strokes)
+    {
+        for (auto& stroke : strokes)
+        {
+            anno_tags().ref(stroke.tag);
+        }
+    }
+
+    anno_stroke_store_t(anno_stroke_store_t&& other) :
+        x(std::move(other.x)), y(std::move(other.y)), strokes(std::move(other.strokes))
+    {
+        other.strokes.clear();
+    }
+
+    anno_stroke_store_t& operator =(anno_stroke_store_t other)
+    {
+        std::swap(x, other.x);
+        std::swap(y, other.y);
+        std::swap(strokes, other.strokes);
+        return *this;
+    }
+
+    ~anno_stroke_store_t()
+    {
+        clear();
+    }
+
+    bool empty() const
+    {
+        return strokes.empty();
+    }
+
+    void clear()
+    {
+        for (auto& stroke : strokes)
+        {
+            anno_tags().unref(stroke.tag);
+        }
+
+        x.clear();
+        y.clear();
+        strokes.clear();
+    }
+
+    anno_stroke_t& begin_stroke(annotate_draw_method method, float width, wf::color_t color,
+        uint32_t tag = 0)
+    {
+        anno_tags().ref(tag);
+        strokes.push_back({method, width, color, (uint32_t)x.size(), 0, tag});
+        return strokes.back();
+    }
+
+    void add_point(wf::pointf_t point)
+    {
+        x.push_back(point.x);
+        y.push_back(point.y);
+        strokes.back().point_count++;
+    }
+
+    /* Moves the last count strokes to the end of another store */
+    void move_last_strokes(uint32_t count, anno_stroke_store_t& to)
+    {
+        size_t first = strokes.size() - count;
+        for (size_t i = first; i < strokes.size(); i++)
+        {
+            to.add_stroke(*this, strokes[i]);
+            anno_tags().unref(strokes[i].tag);
+        }
+
+        x.resize(strokes[first].first_point);
+        y.resize(strokes[first].first_point);
+        strokes.resize(first);
+    }
+
+    size_t memory_size() const
+    {
+        return x.size() * sizeof(float) * 2 + strokes.size() * sizeof(anno_stroke_t);
+    }
+
+    /* Appends a copy of the points [first, last] of a stroke of another
+     * store, along with the points next to them which shape the curve of a
+     * freehand stroke. Returns the index of the point first in the copy.
+     * The copy has no tag, as it is only handed to the rasterizer thread. */
+    uint32_t add_stroke_part(const anno_stroke_store_t& other, const anno_stroke_t& stroke,
+        uint32_t first, uint32_t last)
+    {
+        uint32_t from = (first > 0) ? first - 1 : 0;
+        uint32_t to   = std::min(last + 1, stroke.point_count - 1);
+        begin_stroke(stroke.method, stroke.width, stroke.color);
+        for (uint32_t i = from; i <= to; i++)
+        {
+            add_point(other.point(stroke, i));
+        }
+
+        return first - from;
+    }
+
+    /* Appends a copy of a stroke of another store */
+    void add_stroke(const anno_stroke_store_t& other, const anno_stroke_t& stroke)
+    {
+        begin_stroke(stroke.method, stroke.width, stroke.color, stroke.tag);
+        for (uint32_t i = 0; i < stroke.point_count; i++)
+        {
+            add_point(other.point(stroke, i));
+        }
+    }
+
+    /* Moves the strokes at the given ascending indices to the end of another
+     * store */
+    void remove_strokes(const std::vector<uint32_t>& indices, anno_stroke_store_t& to)
+    {
+        anno_stroke_store_t kept;
+        size_t next = 0;
+        for (uint32_t i = 0; i < strokes.size(); i++)
+        {
+            if ((next < indices.size()) && (indices[next] == i))
+            {
+                to.add_stroke(*this, strokes[i]);
+                next++;
+            } else
+            {
+                kept.add_stroke(*this, strokes[i]);
+            }
+        }
+
+        *this = std::move(kept);
+    }
+
+    /* Inserts the strokes of another store at the given ascending indices,
+     * which reverts remove_strokes() */
+    void insert_strokes(const std::vector<uint32_t>& indices, const anno_stroke_store_t& from)
+    {
+        anno_stroke_store_t merged;
+        size_t next = 0, kept = 0;
+        while ((next < from.strokes.size()) || (kept < strokes.size()))
+        {
+            if ((next < from.strokes.size()) &&
+                ((next < indices.size() && (indices[next] == merged.strokes.size())) ||
+                 (kept == strokes.size())))
+            {
+                merged.add_stroke(from, from.strokes[next++]);
+            } else
+            {
+                merged.add_stroke(*this, strokes[kept++]);
+            }
+        }
+
+        *this = std::move(merged);
+    }
+
+    wf::pointf_t point(const anno_stroke_t& stroke, uint32_t i) const
+    {
+        return {x[stroke.first_point + i], y[stroke.first_point + i]};
+    }
+
+    /*
+     * Freehand strokes are smoothed with a Catmull-Rom spline through their
+     * points. This returns the bezier control points of the segment from
+     * point i to point i + 1, which depends on the points before and after
+     * the segment. Segments at the ends of the stroke repeat the end point.
+     */
+    void get_segment_controls(const anno_stroke_t& stroke, uint32_t i,
+        wf::pointf_t& c1, wf::pointf_t& c2) const
+    {
+        auto p0 = point(stroke, i > 0 ? i - 1 : 0);
+        auto p1 = point(stroke, i);
+        auto p2 = point(stroke, i + 1);
+        auto p3 = point(stroke, std::min(i + 2, stroke.point_count - 1));
+        c1 = {p1.x + (p2.x - p0.x) / 6, p1.y + (p2.y - p0.y) / 6};
+        c2 = {p2.x - (p3.x - p1.x) / 6, p2.y - (p3.y - p1.y) / 6};
+    }
+
+    /* Box covering the points [first, last] of the stroke, including its width */
+    wf::geometry_t get_bbox(const anno_stroke_t& stroke, uint32_t first, uint32_t last) const
+    {
+        double x1, y1, x2, y2;
+        auto p0 = point(stroke, first);
+        if (stroke.method == ANNOTATE_METHOD_CIRCLE)
+        {
+            auto p1 = point(stroke, 1);
+            double radius = std::hypot(p1.x - p0.x, p1.y - p0.y);
+            x1 = p0.x - radius;
+            y1 = p0.y - radius;
+            x2 = p0.x + radius;
+            y2 = p0.y + radius;
+        } else
+        {
+            x1 = x2 = p0.x;
+            y1 = y2 = p0.y;
+            auto add = [&] (wf::pointf_t p)
+            {
+                x1 = std::min(x1, p.x);
+                y1 = std::min(y1, p.y);
+                x2 = std::max(x2, p.x);
+                y2 = std::max(y2, p.y);
+            };
+
+            for (uint32_t i = first + 1; i <= last; i++)
+            {
+                add(point(stroke, i));
+                if (stroke.method == ANNOTATE_METHOD_DRAW)
+                {
+                    /* The curve stays within its control points */
+                    wf::pointf_t c1, c2;
+                    get_segment_controls(stroke, i - 1, c1, c2);
+                    add(c1);
+                    add(c2);
+                }
+            }
+        }
+
+        int padding = stroke.width + 1;
+        wf::geometry_t bbox;
+        bbox.x     = floor(x1) - padding;
+        bbox.y     = floor(y1) - padding;
+        bbox.width = ceil(x2) - floor(x1) + padding * 2;
+        bbox.height = ceil(y2) - floor(y1) + padding * 2;
+        return bbox;
+    }
+
+    wf::geometry_t get_bbox(const anno_stroke_t& stroke) const
+    {
+        return get_bbox(stroke, 0, stroke.point_count - 1);
+    }
+};
+
+static bool boxes_intersect(const wf::geometry_t& a, const wf::geometry_t& b)
+{
+    return (a.x < b.x + b.width) && (b.x < a.x + a.width) &&
+           (a.y < b.y + b.height) && (b.y < a.y + a.height);
+}
+
+static wf::geometry_t boxes_union(const wf::geometry_t& a, const wf::geometry_t& b)
+{
+    int x1 = std::min(a.x, b.x);
+    int y1 = std::min(a.y, b.y);
+    int x2 = std::max(a.x + a.width, b.x + b.width);
+    int y2 = std::max(a.y + a.height, b.y + b.height);
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
+/*
+ * Annotations saved to disk, one file per output. While running, the file is
+ * a log which every change is appended to as it happens. On load it is
+ * mapped and only indexed: the strokes of a workspace are decoded the first
+ * time the workspace is used. Logs with records which no longer matter, like
+ * cleared or undone strokes, are compacted on load by copying the records of
+ * the remaining strokes into a new file.
+ *
+ * File layout, in host byte order:
+ *
+ *   header: "WFANNOTE", u32 version
+ *   records, each starting with u8 type, i32 workspace x, i32 workspace y:
+ *     PERSIST_STROKE: u8 method, f32 width, f32 r, g, b, a, u16 tag length,
+ *                     u32 point count, the tag, f32 x and y of each point
+ *     PERSIST_CLEAR:  no data, removes all strokes of the workspace
+ *     PERSIST_REMOVE: u32 count, u32 index of each stroke removed, ascending
+ *
+ * Version 1 stroke records have neither the tag nor its length. Such files
+ * are still read, and converted when they are compacted on load.
+ */
+class anno_persist_file_t
+{
+    static constexpr char MAGIC[8] = {'W', 'F', 'A', 'N', 'N', 'O', 'T', 'E'};
+    static const uint32_t VERSION     = 2;
+    static const size_t HEADER_SIZE   = 12;
+    static const size_t RECORD_HEADER = 9;
+    static const size_t STROKE_HEADER = RECORD_HEADER + 27;
+    static const size_t STROKE_HEADER_V1 = RECORD_HEADER + 25;
+
+    enum record_type : uint8_t
+    {
+        PERSIST_STROKE = 1,
+        PERSIST_CLEAR  = 2,
+        PERSIST_REMOVE = 3,
+    };
+
+    enum map_result
+    {
+        /* The file was indexed, or does not exist yet */
+        PERSIST_MAP_OK,
+        /* The file was read, but it is not an annotation file */
+        PERSIST_MAP_CORRUPT,
+        /* The file could not be read, or is of an unknown version */
+        PERSIST_MAP_ERROR,
+    };
+
+    std::string path;
+    int fd = -1;
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint32_t version = VERSION;
+
+    template<class T>
+    static void put(std::vector<uint8_t>& out, T value)
+    {
+        auto bytes = (const uint8_t*)&value;
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<class T>
+    T get(size_t offset) const
+    {
+        T value;
+        memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+
+    static void put_record_header(std::vector<uint8_t>& out, record_type type, wf::point_t ws)
+    {
+        put<uint8_t>(out, type);
+        put<int32_t>(out, ws.x);
+        put<int32_t>(out, ws.y);
+    }
+
+    static void put_stroke(std::vector<uint8_t>& out, wf::point_t ws,
+        const anno_stroke_store_t& store, const anno_stroke_t& stroke)
+    {
+        put_record_header(out, PERSIST_STROKE, ws);
+        put<uint8_t>(out, stroke.method);
+        put<float>(out, stroke.width);
+        put<float>(out, stroke.color.r);
+        put<float>(out, stroke.color.g);
+        put<float>(out, stroke.color.b);
+        put<float>(out, stroke.color.a);
+        auto& tag = anno_tags().name(stroke.tag);
+        put<uint16_t>(out, tag.size());
+        put<uint32_t>(out, stroke.point_count);
+        out.insert(out.end(), tag.begin(), tag.end());
+        for (uint32_t i = 0; i < stroke.point_count; i++)
+        {
+            auto p = store.point(stroke, i);
+            put<float>(out, p.x);
+            put<float>(out, p.y);
+        }
+    }
+
+    void unmap()
+    {
+        if (data)
+        {
+            munmap((void*)data, size);
+            data = nullptr;
+            size = 0;
+        }
+    }
+
+    /* Replaces the file with the given contents, atomically */
+    bool replace(const std::vector<uint8_t>& contents)
+    {
+        std::string tmp = path + ".tmp";
+        int tmp_fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (tmp_fd < 0)
+        {
+            return false;
+        }
+
+        size_t written = 0;
+        while (written < contents.size())
+        {
+            ssize_t ret = ::write(tmp_fd, contents.data() + written, contents.size() - written);
+            if (ret < 0)
+            {
+                ::close(tmp_fd);
+                unlink(tmp.c_str());
+                return false;
+            }
+
+            written += ret;
+        }
+
+        ::close(tmp_fd);
+        return rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    void append(const std::vector<uint8_t>& record)
+    {
+        if ((fd >= 0) && (::write(fd, record.data(), record.size()) != (ssize_t)record.size()))
+        {
+            LOGE("annotate: failed to save to ", path, ", not saving any more changes");
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+  public:
+    /* Offset and size of a stroke record, by workspace */
+    std::map<std::pair<int, int>, std::vector<std::pair<size_t, size_t>>> index;
+
+    ~anno_persist_file_t()
+    {
+        close();
+        unmap();
+    }
+
+    /*
+     * Maps and indexes the file at path, compacting it if needed, and opens
+     * it for appending. Returns false if it cannot be written, or cannot be
+     * read, in which case it is left alone.
+     */
+    bool open(const std::string& path)
+    {
+        this->path = path;
+        bool compact = false;
+        auto result  = map(compact);
+        if (result == PERSIST_MAP_ERROR)
+        {
+            return false;
+        }
+
+        if (result == PERSIST_MAP_CORRUPT)
+        {
+            std::string backup = path + ".bak";
+            LOGE("annotate: ", path, " is not an annotation file, moving it to ", backup);
+            if (rename(path.c_str(), backup.c_str()) != 0)
+            {
+                return false;
+            }
+
+            compact = true;
+            index.clear();
+        }
+
+        if (compact)
+        {
+            std::vector<uint8_t> contents(MAGIC, MAGIC + sizeof(MAGIC));
+            put<uint32_t>(contents, VERSION);
+            for (auto& [ws, records] : index)
+            {
+                for (auto& record : records)
+                {
+                    if (version == VERSION)
+                    {
+                        contents.insert(contents.end(), data + record.first,
+                            data + record.first + record.second);
+                    } else
+                    {
+                        anno_stroke_store_t store;
+                        read_stroke(record, store);
+                        put_stroke(contents, {ws.first, ws.second}, store, store.strokes.back());
+                    }
+                }
+            }
+
+            unmap();
+            index.clear();
+            if (!replace(contents) || (map(compact) != PERSIST_MAP_OK))
+            {
+                return false;
+            }
+        }
+
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        return fd >= 0;
+    }
+
+    /* Maps the file and builds the index. compact is set if the file has
+     * records which are not needed any more, or a truncated record. */
+    map_result map(bool& compact)
+    {
+        version = VERSION;
+        int map_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (map_fd < 0)
+        {
+            compact = true;
+            return (errno == ENOENT) ? PERSIST_MAP_OK : PERSIST_MAP_ERROR;
+        }
+
+        struct stat st;
+        if (fstat(map_fd, &st) < 0)
+        {
+            ::close(map_fd);
+            return PERSIST_MAP_ERROR;
+        }
+
+        if ((size_t)st.st_size < HEADER_SIZE)
+        {
+            ::close(map_fd);
+            compact = true;
+            return (st.st_size == 0) ? PERSIST_MAP_OK : PERSIST_MAP_CORRUPT;
+        }
+
+        size = st.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, map_fd, 0);
+        ::close(map_fd);
+        if (mapping == MAP_FAILED)
+        {
+            size = 0;
+            return PERSIST_MAP_ERROR;
+        }
+
+        data = (const uint8_t*)mapping;
+        if (memcmp(data, MAGIC, sizeof(MAGIC)))
+        {
+            unmap();
+            return PERSIST_MAP_CORRUPT;
+        }
+
+        version = get<uint32_t>(sizeof(MAGIC));
+        if ((version != 1) && (version != VERSION))
+        {
+            LOGE("annotate: ", path, " is of an unknown version, not saving annotations");
+            unmap();
+            return PERSIST_MAP_ERROR;
+        }
+
+        /* Older files are converted to the current version */
+        compact |= (version != VERSION);
+
+        size_t offset = HEADER_SIZE;
+        while (offset + RECORD_HEADER <= size)
+        {
+            auto type = get<uint8_t>(offset);
+            auto& records = index[{get<int32_t>(offset + 1), get<int32_t>(offset + 5)}];
+            size_t length = RECORD_HEADER;
+            if (type == PERSIST_STROKE)
+            {
+                size_t header = (version == 1) ? STROKE_HEADER_V1 : STROKE_HEADER;
+                if (offset + header > size)
+                {
+                    break;
+                }
+
+                length = header + get<uint32_t>(offset + header - 4) * 8ul;
+                if (version != 1)
+                {
+                    length += get<uint16_t>(offset + header - 6);
+                }
+
+                if (offset + length > size)
+                {
+                    break;
+                }
+
+                records.push_back({offset, length});
+            } else if (type == PERSIST_CLEAR)
+            {
+                compact = true;
+                records.clear();
+            } else if (type == PERSIST_REMOVE)
+            {
+                uint32_t count = (offset + length + 4 <= size) ? get<uint32_t>(offset + length) : 0;
+                length += 4 + count * 4ul;
+                if (offset + length > size)
+                {
+                    break;
+                }
+
+                compact = true;
+                for (uint32_t i = count; i > 0; i--)
+                {
+                    uint32_t removed = get<uint32_t>(offset + RECORD_HEADER + i * 4);
+                    if (removed < records.size())
+                    {
+                        records.erase(records.begin() + removed);
+                    }
+                }
+            } else
+            {
+                break;
+            }
+
+            offset += length;
+        }
+
+        compact |= (offset != size);
+        return PERSIST_MAP_OK;
+    }
+
+    /* Decodes a stroke record and appends the stroke to store */
+    void read_stroke(std::pair<size_t, size_t> record, anno_stroke_store_t& store) const
+    {
+        size_t offset = record.first + RECORD_HEADER;
+        wf::color_t color{get<float>(offset + 5), get<float>(offset + 9),
+            get<float>(offset + 13), get<float>(offset + 17)};
+        auto method = (annotate_draw_method)get<uint8_t>(offset);
+        float width = get<float>(offset + 1);
+        uint16_t tag_length = 0;
+        uint32_t count;
+        if (version == 1)
+        {
+            count   = get<uint32_t>(offset + 21);
+            offset += 25;
+        } else
+        {
+            tag_length = get<uint16_t>(offset + 21);
+            count   = get<uint32_t>(offset + 23);
+            offset += 27;
+        }
+
+        uint32_t tag = anno_tags().ref(std::string((const char*)data + offset, tag_length));
+        store.begin_stroke(method, width, color, tag);
+        anno_tags().unref(tag);
+        offset += tag_length;
+        for (uint32_t i = 0; i < count; i++, offset += 8)
+        {
+            store.add_point({get<float>(offset), get<float>(offset + 4)});
+        }
+    }
+
+    /* Appends the strokes of store from index first on */
+    void write_strokes(wf::point_t ws, const anno_stroke_store_t& store, size_t first)
+    {
+        std::vector<uint8_t> records;
+        for (size_t i = first; i < store.strokes.size(); i++)
+        {
+            put_stroke(records, ws, store, store.strokes[i]);
+        }
+
+        append(records);
+    }
+
+    void write_clear(wf::point_t ws)
+    {
+        std::vector<uint8_t> record;
+        put_record_header(record, PERSIST_CLEAR, ws);
+        append(record);
+    }
+
+    /* Records that the strokes at the given ascending indices were removed */
+    void write_remove(wf::point_t ws, const std::vector<uint32_t>& indices)
+    {
+        std::vector<uint8_t> record;
+        put_record_header(record, PERSIST_REMOVE, ws);
+        put<uint32_t>(record, indices.size());
+        for (auto i : indices)
+        {
+            put<uint32_t>(record, i);
+        }
+
+        append(record);
+    }
+
+    /* Replaces the file with the strokes of all workspaces, and appends to
+     * it from now on */
+    bool write_all(const std::string& path,
+        const std::vector<std::pair<wf::point_t, const anno_stroke_store_t*>>& workspaces)
+    {
+        close();
+        unmap();
+        index.clear();
+        this->path = path;
+        version    = VERSION;
+
+        std::vector<uint8_t> contents(MAGIC, MAGIC + sizeof(MAGIC));
+        put<uint32_t>(contents, VERSION);
+        for (auto& [ws, store] : workspaces)
+        {
+            for (auto& stroke : store->strokes)
+            {
+                put_stroke(contents, ws, *store, stroke);
+            }
+        }
+
+        if (!replace(contents))
+        {
+            return false;
+        }
+
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        return fd >= 0;
+    }
+
+    /* Stops saving changes. Strokes which have not been loaded yet can still
+     * be read from the mapping. */
+    void close()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+/* Strokes the points [first, last] of a freehand stroke, or a whole shape */
+static void cairo_stroke_annotation(cairo_t *cr, const anno_stroke_store_t& store,
+    const anno_stroke_t& stroke, uint32_t first, uint32_t last)
+{
+    auto p0 = store.point(stroke, first);
+    auto p1 = store.point(stroke, std::min(first + 1, stroke.point_count - 1));
+
+    cairo_set_line_width(cr, stroke.width);
+    cairo_set_source_rgba(cr, stroke.color.r, stroke.color.g, stroke.color.b, stroke.color.a);
+    switch (stroke.method)
+    {
+      case ANNOTATE_METHOD_DRAW:
+        /* Round caps hide the seams between parts of a stroke drawn in
+         * different frames */
+        cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+        cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+        cairo_move_to(cr, p0.x, p0.y);
+        for (uint32_t i = first; i < last; i++)
+        {
+            wf::pointf_t c1, c2;
+            auto p = store.point(stroke, i + 1);
+            store.get_segment_controls(stroke, i, c1, c2);
+            cairo_curve_to(cr, c1.x, c1.y, c2.x, c2.y, p.x, p.y);
+        }
+
+        break;
+
+      case ANNOTATE_METHOD_LINE:
+        cairo_move_to(cr, p0.x, p0.y);
+        cairo_line_to(cr, p1.x, p1.y);
+        break;
+
+      case ANNOTATE_METHOD_RECTANGLE:
+        cairo_rectangle(cr, p0.x, p0.y, p1.x - p0.x, p1.y - p0.y);
+        break;
+
+      case ANNOTATE_METHOD_CIRCLE:
+        cairo_arc(cr, p0.x, p0.y, std::hypot(p1.x - p0.x, p1.y - p0.y), 0, 2 * M_PI);
+        break;
+
+      case ANNOTATE_METHOD_POLYLINE:
+        /* Round joins keep sharp corners within the bounding box */
+        cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+        cairo_move_to(cr, p0.x, p0.y);
+        for (uint32_t i = first + 1; i <= last; i++)
+        {
+            auto p = store.point(stroke, i);
+            cairo_line_to(cr, p.x, p.y);
+        }
+
+        break;
+    }
+
+    cairo_stroke(cr);
+}
+
+/* A tile of the raster cache of a drawing, only used by the rasterizer thread */
+struct anno_tile_t
+{
+    /* Position and size of the tile in the drawing */
+    wf::geometry_t geometry;
+    cairo_t *cr = nullptr;
+    cairo_surface_t *cairo_surface = nullptr;
+    /* Part of the tile drawn on since it was last sent out, in tile pixels */
+    wf::geometry_t dirty = {0, 0, 0, 0};
+};
+
+/* Changed pixels of a tile, sent from the rasterizer thread to be uploaded */
+struct anno_tile_update_t
+{
+    uint64_t drawing;
+    uint64_t generation;
+    int tile;
+    /* Size of the whole tile in pixels */
+    int tile_width;
+    int tile_height;
+    /* The updated part of the tile in tile pixels, and in logical coordinates */
+    wf::geometry_t box;
+    wf::geometry_t damage;
+    /* ARGB32 pixels of box, without padding between rows */
+    std::vector<uint8_t> pixels;
+};
+
+/*
+ * Work for the rasterizer thread. A job is self-contained: it carries a copy
+ * of the strokes it draws, so that the main thread can keep changing its
+ * strokes meanwhile.
+ */
+struct anno_raster_job_t
+{
+    anno_raster_job_type type;
+    uint64_t drawing;
+    /* Jobs with a different generation than the tiles of the drawing start
+     * over with empty tiles */
+    uint64_t generation;
+    uint64_t serial;
+    int width;
+    int height;
+    float scale;
+    /* If not empty, this area is cleared and only the strokes are drawn
+     * within it */
+    wf::geometry_t clear_box = {0, 0, 0, 0};
+    anno_stroke_store_t strokes;
+    /* The points [first, last] drawn of each stroke */
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+
+    void add_stroke(const anno_stroke_store_t& store, const anno_stroke_t& stroke,
+        uint32_t first, uint32_t last)
+    {
+        uint32_t offset = strokes.add_stroke_part(store, stroke, first, last);
+        ranges.push_back({offset, offset + last - first});
+    }
+};
+
+/*
+ * The raster cache of one drawing, at the output size and scale. Tiles are
+ * allocated when something is first drawn on them, so a few strokes only cost
+ * the memory of the tiles they touch. The cairo context of each tile is
+ * transformed, so that all drawing happens in logical workspace coordinates.
+ */
+struct anno_tile_set_t
+{
+    uint64_t generation = 0;
+    int width   = 0;
+    int height  = 0;
+    float scale = 1.0;
+    int columns = 0;
+    int rows    = 0;
+    std::vector<std::unique_ptr<anno_tile_t>> tiles;
+
+    ~anno_tile_set_t()
+    {
+        free();
+    }
+
+    void free()
+    {
+        for (auto& tile : tiles)
+        {
+            if (tile)
+            {
+                cairo_destroy(tile->cr);
+                cairo_surface_destroy(tile->cairo_surface);
+            }
+        }
+
+        tiles.clear();
+    }
+
+    void reset(const anno_raster_job_t& job)
+    {
+        free();
+        generation = job.generation;
+        width   = job.width;
+        height  = job.height;
+        scale   = job.scale;
+        columns = (width + ANNOTATE_TILE_SIZE - 1) / ANNOTATE_TILE_SIZE;
+        rows    = (height + ANNOTATE_TILE_SIZE - 1) / ANNOTATE_TILE_SIZE;
+        tiles.resize(columns * rows);
+    }
+
+    /* Pixel box of the intersection of box with the tile */
+    wf::geometry_t tile_pixel_box(const anno_tile_t& tile, wf::geometry_t box)
+    {
+        auto& g = tile.geometry;
+        int w   = cairo_image_surface_get_width(tile.cairo_surface);
+        int h   = cairo_image_surface_get_height(tile.cairo_surface);
+        int x1  = wf::clamp((int)floor((box.x - g.x) * w / (double)g.width), 0, w);
+        int y1  = wf::clamp((int)floor((box.y - g.y) * h / (double)g.height), 0, h);
+        int x2  = wf::clamp((int)ceil((box.x + box.width - g.x) * w / (double)g.width), 0, w);
+        int y2  = wf::clamp((int)ceil((box.y + box.height - g.y) * h / (double)g.height), 0, h);
+        return {x1, y1, x2 - x1, y2 - y1};
+    }
+
+    /* Calls fn with each tile which intersects box, given in logical
+     * coordinates, and marks the intersection as dirty. Missing tiles are
+     * skipped unless allocate is set. */
+    void for_each_tile(wf::geometry_t box, bool allocate, std::function<void(anno_tile_t&)> fn)
+    {
+        int x1 = std::max(box.x, 0);
+        int y1 = std::max(box.y, 0);
+        int x2 = std::min(box.x + box.width, width);
+        int y2 = std::min(box.y + box.height, height);
+        if ((x1 >= x2) || (y1 >= y2))
+        {
+            return;
+        }
+
+        for (int row = y1 / ANNOTATE_TILE_SIZE; row <= (y2 - 1) / ANNOTATE_TILE_SIZE; row++)
+        {
+            for (int col = x1 / ANNOTATE_TILE_SIZE; col <= (x2 - 1) / ANNOTATE_TILE_SIZE; col++)
+            {
+                auto& tile = tiles[row * columns + col];
+                if (!tile)
+                {
+                    if (!allocate)
+                    {
+                        continue;
+                    }
+
+                    tile = create_tile(col, row);
+                }
+
+                auto damage = tile_pixel_box(*tile, box);
+                if ((tile->dirty.width <= 0) || (tile->dirty.height <= 0))
+                {
+                    tile->dirty = damage;
+                } else
+                {
+                    int dx2 = std::max(tile->dirty.x + tile->dirty.width, damage.x + damage.width);
+                    int dy2 = std::max(tile->dirty.y + tile->dirty.height, damage.y + damage.height);
+                    tile->dirty.x     = std::min(tile->dirty.x, damage.x);
+                    tile->dirty.y     = std::min(tile->dirty.y, damage.y);
+                    tile->dirty.width = dx2 - tile->dirty.x;
+                    tile->dirty.height = dy2 - tile->dirty.y;
+                }
+
+                fn(*tile);
+            }
+        }
+    }
+
+    std::unique_ptr<anno_tile_t> create_tile(int col, int row)
+    {
+        auto tile = std::make_unique<anno_tile_t>();
+        tile->geometry.x     = col * ANNOTATE_TILE_SIZE;
+        tile->geometry.y     = row * ANNOTATE_TILE_SIZE;
+        tile->geometry.width = std::min(ANNOTATE_TILE_SIZE, width - tile->geometry.x);
+        tile->geometry.height = std::min(ANNOTATE_TILE_SIZE, height - tile->geometry.y);
+
+        /* Tiles cover whole logical pixels, so their scale is adjusted
+         * slightly to have a whole number of physical pixels too */
+        int w = std::max(1, (int)round(tile->geometry.width * scale));
+        int h = std::max(1, (int)round(tile->geometry.height * scale));
+        tile->cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+        tile->cr = cairo_create(tile->cairo_surface);
+        cairo_scale(tile->cr, w / (double)tile->geometry.width, h / (double)tile->geometry.height);
+        cairo_translate(tile->cr, -tile->geometry.x, -tile->geometry.y);
+
+        /* The texture of a new tile is filled by its first update */
+        tile->dirty = {0, 0, w, h};
+        return tile;
+    }
+
+    void draw(const anno_raster_job_t& job)
+    {
+        auto& box = job.clear_box;
+        if ((box.width <= 0) || (box.height <= 0))
+        {
+            for (size_t i = 0; i < job.strokes.strokes.size(); i++)
+            {
+                auto& stroke = job.strokes.strokes[i];
+                auto range   = job.ranges[i];
+                for_each_tile(job.strokes.get_bbox(stroke, range.first, range.second), true,
+                    [&] (anno_tile_t& tile)
+                {
+                    cairo_save(tile.cr);
+                    cairo_stroke_annotation(tile.cr, job.strokes, stroke, range.first, range.second);
+                    cairo_restore(tile.cr);
+                });
+            }
+
+            return;
+        }
+
+        for_each_tile(box, false, [&] (anno_tile_t& tile)
+        {
+            auto pixels = tile_pixel_box(tile, box);
+            cairo_matrix_t matrix;
+            cairo_save(tile.cr);
+            cairo_get_matrix(tile.cr, &matrix);
+            cairo_identity_matrix(tile.cr);
+            cairo_rectangle(tile.cr, pixels.x, pixels.y, pixels.width, pixels.height);
+            cairo_clip(tile.cr);
+            cairo_set_operator(tile.cr, CAIRO_OPERATOR_CLEAR);
+            cairo_paint(tile.cr);
+            cairo_set_operator(tile.cr, CAIRO_OPERATOR_OVER);
+            cairo_set_matrix(tile.cr, &matrix);
+            for (size_t i = 0; i < job.strokes.strokes.size(); i++)
+            {
+                cairo_save(tile.cr);
+                cairo_stroke_annotation(tile.cr, job.strokes, job.strokes.strokes[i],
+                    job.ranges[i].first, job.ranges[i].second);
+                cairo_restore(tile.cr);
+            }
+
+            cairo_restore(tile.cr);
+        });
+    }
+
+    /* Copies out the dirty part of each tile */
+    void collect(uint64_t drawing, std::vector<anno_tile_update_t>& updates)
+    {
+        for (size_t i = 0; i < tiles.size(); i++)
+        {
+            auto& tile = tiles[i];
+            if (!tile || (tile->dirty.width <= 0) || (tile->dirty.height <= 0))
+            {
+                continue;
+            }
+
+            cairo_surface_flush(tile->cairo_surface);
+            auto& g = tile->geometry;
+            auto& box = tile->dirty;
+            anno_tile_update_t update;
+            update.drawing     = drawing;
+            update.generation  = generation;
+            update.tile        = i;
+            update.tile_width  = cairo_image_surface_get_width(tile->cairo_surface);
+            update.tile_height = cairo_image_surface_get_height(tile->cairo_surface);
+            update.box = box;
+
+            double sx = g.width / (double)update.tile_width;
+            double sy = g.height / (double)update.tile_height;
+            int x1    = g.x + floor(box.x * sx);
+            int y1    = g.y + floor(box.y * sy);
+            update.damage = {x1, y1, (int)(g.x + ceil((box.x + box.width) * sx)) - x1,
+                (int)(g.y + ceil((box.y + box.height) * sy)) - y1};
+
+            auto data  = cairo_image_surface_get_data(tile->cairo_surface);
+            int stride = cairo_image_surface_get_stride(tile->cairo_surface);
+            update.pixels.resize(box.width * box.height * 4);
+            for (int y = 0; y < box.height; y++)
+            {
+                memcpy(update.pixels.data() + y * box.width * 4,
+                    data + (box.y + y) * stride + box.x * 4, box.width * 4);
+            }
+
+            updates.push_back(std::move(update));
+            tile->dirty = {0, 0, 0, 0};
+        }
+    }
+};
+
+/*
+ * Rasterizes strokes on a thread of its own, so that stroking large or
+ * thick paths never delays a frame. The thread owns the cairo tiles, and
+ * sends copies of their changed pixels back, which the main thread uploads
+ * to its textures. The main thread never waits for the rasterizer: it only
+ * try-locks the queues, which the thread holds just to move jobs and updates
+ * in and out, and retries when idle if they are busy.
+ */
+class anno_rasterizer_t
+{
+    std::thread thread;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cond;
+    std::vector<anno_raster_job_t> jobs;
+    bool quit = false;
+    std::mutex updates_mutex;
+    std::vector<anno_tile_update_t> updates;
+    uint64_t done_serial = 0;
+    /* Signaled by the thread when updates are ready */
+    int event_fd = -1;
+    wl_event_source *event_source = nullptr;
+
+    /* Main thread only */
+    std::vector<anno_raster_job_t> pending;
+    uint64_t next_serial   = 1;
+    uint64_t next_drawing  = 1;
+    wf::wl_idle_call retry_flush, retry_deliver;
+
+    /* Rasterizer thread only */
+    std::map<uint64_t, anno_tile_set_t> drawings;
+
+    static int handle_event(int fd, uint32_t mask, void *data)
+    {
+        uint64_t count;
+        if (read(fd, &count, sizeof(count)) == sizeof(count))
+        {
+            ((anno_rasterizer_t*)data)->deliver();
+        }
+
+        return 0;
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            std::vector<anno_raster_job_t> batch;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex);
+                jobs_cond.wait(lock, [=] { return quit || !jobs.empty(); });
+                if (quit)
+                {
+                    return;
+                }
+
+                std::swap(batch, jobs);
+            }
+
+            for (auto& job : batch)
+            {
+                if (job.type == ANNOTATE_JOB_RELEASE)
+                {
+                    drawings.erase(job.drawing);
+                    continue;
+                }
+
+                auto& tiles = drawings[job.drawing];
+                if ((tiles.generation != job.generation) || tiles.tiles.empty())
+                {
+                    tiles.reset(job);
+                }
+
+                tiles.draw(job);
+            }
+
+            std::vector<anno_tile_update_t> done;
+            for (auto& [drawing, tiles] : drawings)
+            {
+                tiles.collect(drawing, done);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(updates_mutex);
+                std::move(done.begin(), done.end(), std::back_inserter(updates));
+                done_serial = batch.back().serial;
+            }
+
+            uint64_t one = 1;
+            if (write(event_fd, &one, sizeof(one)) != sizeof(one))
+            {
+                LOGE("annotate: failed to signal the main thread");
+            }
+        }
+    }
+
+    /* Hands the pending jobs over to the thread */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(jobs_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            retry_flush.run_once([=] { flush(); });
+            return;
+        }
+
+        std::move(pending.begin(), pending.end(), std::back_inserter(jobs));
+        pending.clear();
+        jobs_cond.notify_one();
+    }
+
+    void deliver()
+    {
+        std::vector<anno_tile_update_t> ready;
+        uint64_t serial;
+        {
+            std::unique_lock<std::mutex> lock(updates_mutex, std::try_to_lock);
+            if (!lock.owns_lock())
+            {
+                retry_deliver.run_once([=] { deliver(); });
+                return;
+            }
+
+            std::swap(ready, updates);
+            serial = done_serial;
+        }
+
+        if (on_updates)
+        {
+            on_updates(ready, serial);
+        }
+    }
+
+  public:
+    /* Called on the main thread with the updated tiles, and the serial of the
+     * last job which they include */
+    std::function<void(std::vector<anno_tile_update_t>&, uint64_t)> on_updates;
+
+    anno_rasterizer_t()
+    {
+        event_fd     = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        event_source = wl_event_loop_add_fd(wf::get_core().ev_loop, event_fd,
+            WL_EVENT_READABLE, handle_event, this);
+        thread = std::thread([=] { run(); });
+    }
+
+    ~anno_rasterizer_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            quit = true;
+        }
+
+        jobs_cond.notify_one();
+        thread.join();
+        retry_flush.disconnect();
+        retry_deliver.disconnect();
+        wl_event_source_remove(event_source);
+        close(event_fd);
+    }
+
+    uint64_t new_drawing()
+    {
+        return next_drawing++;
+    }
+
+    /* Queues a job, and returns its serial */
+    uint64_t submit(anno_raster_job_t job)
+    {
+        uint64_t serial = job.serial = next_serial++;
+        pending.push_back(std::move(job));
+        flush();
+        return serial;
+    }
+};
+
+static void upload_to_texture_with_damage(const anno_tile_update_t& update,
+    simple_texture_t& buffer)
+{
+    buffer.width  = update.tile_width;
+    buffer.height = update.tile_height;
+
+    wf::gles::run_in_context([&]
+    {
+        if (buffer.tex == (GLuint) - 1)
+        {
+            GL_CALL(glGenTextures(1, &buffer.tex));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                GL_LINEAR));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                GL_LINEAR));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
+            GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                buffer.width, buffer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+        }
+
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0,
+            update.box.x, update.box.y, update.box.width, update.box.height,
+            GL_RGBA, GL_UNSIGNED_BYTE, update.pixels.data()));
+    });
+}
+
+/*
+ * The drawing on one workspace. The strokes are the drawing itself, the
+ * textures are a raster cache of them at the output size and scale, which
+ * the rasterizer thread keeps up to date. The whole cache is dropped while
+ * the workspace is not shown, or when the output size or scale changes, and
+ * is rebuilt from the strokes the next time the drawing is rendered.
+ */
+struct anno_ws_overlay
+{
+    anno_stroke_store_t strokes;
+    int width   = 0;
+    int height  = 0;
+    float scale = 1.0;
+    int columns = 0;
+    int rows    = 0;
+    /* Whether all strokes have been sent to the rasterizer */
+    bool rasterized = true;
+    std::shared_ptr<anno_rasterizer_t> rasterizer;
+    uint64_t drawing;
+    /* Bumped whenever the raster cache is dropped */
+    uint64_t generation = 1;
+    std::vector<simple_texture_t> textures;
+    /* Saved strokes which have not been loaded yet */
+    std::shared_ptr<anno_persist_file_t> saved;
+    std::vector<std::pair<size_t, size_t>> saved_strokes;
+
+    anno_ws_overlay(std::shared_ptr<anno_rasterizer_t> rasterizer)
+    {
+        this->rasterizer = rasterizer;
+        drawing = rasterizer->new_drawing();
+    }
+
+    bool is_empty() const
+    {
+        for (auto& texture : textures)
+        {
+            if (texture.tex != (GLuint) - 1)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void set_size(int w, int h, float s)
+    {
+        if ((w == width) && (h == height) && (s == scale))
+        {
+            return;
+        }
+
+        release();
+        width   = w;
+        height  = h;
+        scale   = s;
+        columns = (w + ANNOTATE_TILE_SIZE - 1) / ANNOTATE_TILE_SIZE;
+        rows    = (h + ANNOTATE_TILE_SIZE - 1) / ANNOTATE_TILE_SIZE;
+        textures.clear();
+        textures.resize(columns * rows);
+    }
+
+    /* Frees all tiles, keeping the strokes to rasterize them again later */
+    void release()
+    {
+        rasterized = strokes.empty();
+        generation++;
+        rasterizer->submit(new_job(ANNOTATE_JOB_RELEASE));
+        if (is_empty())
+        {
+            return;
+        }
+
+        wf::gles::run_in_context([&]
+        {
+            for (auto& texture : textures)
+            {
+                if (texture.tex != (GLuint) - 1)
+                {
+                    glDeleteTextures(1, &texture.tex);
+                    texture.tex = -1;
+                }
+            }
+        });
+    }
+
+    void clear()
+    {
+        strokes = {};
+        release();
+    }
+
+    anno_raster_job_t new_job(anno_raster_job_type type)
+    {
+        anno_raster_job_t job;
+        job.type       = type;
+        job.drawing    = drawing;
+        job.generation = generation;
+        job.width  = width;
+        job.height = height;
+        job.scale  = scale;
+        return job;
+    }
+
+    /* Loads the saved strokes, before the drawing is first used */
+    void ensure_restored()
+    {
+        if (!saved)
+        {
+            return;
+        }
+
+        for (auto& record : saved_strokes)
+        {
+            saved->read_stroke(record, strokes);
+        }
+
+        saved.reset();
+        saved_strokes.clear();
+        rasterized = strokes.empty();
+    }
+
+    void ensure_rasterized()
+    {
+        ensure_restored();
+        if (rasterized)
+        {
+            return;
+        }
+
+        auto job = new_job(ANNOTATE_JOB_DRAW);
+        for (auto& stroke : strokes.strokes)
+        {
+            job.add_stroke(strokes, stroke, 0, stroke.point_count - 1);
+        }
+
+        rasterizer->submit(std::move(job));
+        rasterized = true;
+    }
+
+    /* Rasterizes the points [first, last] of a stroke, see
+     * cairo_stroke_annotation(). Returns the serial of the job. */
+    uint64_t draw_stroke(const anno_stroke_store_t& store, const anno_stroke_t& stroke,
+        uint32_t first, uint32_t last)
+    {
+        auto job = new_job(ANNOTATE_JOB_DRAW);
+        job.add_stroke(store, stroke, first, last);
+        return rasterizer->submit(std::move(job));
+    }
+
+    /* Rasterizes the strokes from index first on, in a single job */
+    void draw_strokes(size_t first)
+    {
+        if (!rasterized)
+        {
+            return;
+        }
+
+        auto job = new_job(ANNOTATE_JOB_DRAW);
+        for (size_t i = first; i < strokes.strokes.size(); i++)
+        {
+            job.add_stroke(strokes, strokes.strokes[i], 0, strokes.strokes[i].point_count - 1);
+        }
+
+        rasterizer->submit(std::move(job));
+    }
+
+    /* Rasterizes the strokes within box again, after strokes were removed
+     * or inserted. Only the tiles and strokes intersecting box are touched. */
+    void redraw(wf::geometry_t box)
+    {
+        if (!rasterized)
+        {
+            return;
+        }
+
+        auto job = new_job(ANNOTATE_JOB_DRAW);
+        job.clear_box = box;
+        for (auto& stroke : strokes.strokes)
+        {
+            if (boxes_intersect(strokes.get_bbox(stroke), box))
+            {
+                job.add_stroke(strokes, stroke, 0, stroke.point_count - 1);
+            }
+        }
+
+        rasterizer->submit(std::move(job));
+    }
+
+    /* Uploads an update from the rasterizer, unless it is for a raster cache
+     * which has been dropped since */
+    bool apply(const anno_tile_update_t& update)
+    {
+        if ((update.generation != generation) || (update.tile >= (int)textures.size()))
+        {
+            return false;
+        }
+
+        upload_to_texture_with_damage(update, textures[update.tile]);
+        return true;
+    }
+
+    /* Renders the tiles intersecting box, with the drawing placed at origin */
+    void render(const wf::render_target_t& target, wf::point_t origin, const wf::geometry_t& box)
+    {
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].tex == (GLuint) - 1)
+            {
+                continue;
+            }
+
+            wf::geometry_t g;
+            g.x     = (i % columns) * ANNOTATE_TILE_SIZE;
+            g.y     = (i / columns) * ANNOTATE_TILE_SIZE;
+            g.width = std::min(ANNOTATE_TILE_SIZE, width - g.x);
+            g.height = std::min(ANNOTATE_TILE_SIZE, height - g.y);
+            g.x += origin.x;
+            g.y += origin.y;
+            if ((g.x >= box.x + box.width) || (g.y >= box.y + box.height) ||
+                (g.x + g.width <= box.x) || (g.y + g.height <= box.y))
+            {
+                continue;
+            }
+
+            OpenGL::render_texture(wf::gles_texture_t{textures[i].tex}, target, g,
+                glm::vec4(1.0), OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+        }
+    }
+};
+
+/*
+ * An undoable change to the strokes of a workspace. Strokes which are added
+ * stay in the workspace and are only moved into the entry when the change is
+ * undone. Strokes which are cleared or removed are moved into the entry until
+ * the change is undone. Undo and redo move the strokes back and forth.
+ */
+struct anno_history_entry_t
+{
+    anno_history_action action;
+    wf::point_t workspace;
+    /* Number of strokes added */
+    uint32_t count;
+    anno_stroke_store_t strokes;
+    /* Ascending indices of the strokes removed */
+    std::vector<uint32_t> indices;
+
+    size_t memory_size() const
+    {
+        return sizeof(*this) + strokes.memory_size() + indices.size() * sizeof(uint32_t);
+    }
+};
+
+static const char *shape_vertex_shader =
+    R"(
+#version 100
+
+attribute highp vec2 position;
+
+varying highp vec2 pos;
+
+uniform mat4 mvp;
+
+void main() {
+
+   gl_Position = mvp * vec4(position.xy, 0.0, 1.0);
+   pos = position;
+}
+)";
+
+/*
+ * Draws the outline of a shape from its signed distance, which is negative
+ * inside the stroke, with a one pixel wide antialiased edge. Lines have butt
+ * caps and rectangles sharp corners, like the shapes stroked with cairo.
+ */
+static const char *shape_fragment_shader =
+    R"(
+#version 100
+
+precision highp float;
+
+varying highp vec2 pos;
+
+uniform int shape;
+uniform vec2 p0;
+uniform vec2 p1;
+uniform float half_width;
+uniform float scale;
+uniform vec4 color;
+
+void main()
+{
+    float d;
+    if (shape == 1)
+    {
+        vec2 ba = p1 - p0;
+        float len = length(ba);
+        vec2 dir = len > 0.0 ? ba / len : vec2(1.0, 0.0);
+        vec2 pa = pos - p0;
+        float along = dot(pa, dir);
+        float across = abs(dot(pa, vec2(-dir.y, dir.x)));
+        d = max(across - half_width, max(-along, along - len));
+    } else if (shape == 2)
+    {
+        vec2 q = abs(pos - (p0 + p1) * 0.5) - abs(p1 - p0) * 0.5;
+        d = abs(max(q.x, q.y)) - half_width;
+    } else
+    {
+        d = abs(length(pos - p0) - length(p1 - p0)) - half_width;
+    }
 
-struct anno_ws_overlay
+    float alpha = clamp(0.5 - d * scale, 0.0, 1.0) * color.a;
+    gl_FragColor = vec4(color.rgb * alpha, alpha);
+}
+)";
+
+/*
+ * The shape being dragged out, drawn directly on the GPU from its defining
+ * points, so that moving it costs no rasterization or texture upload. It is
+ * only rasterized into the drawing when it is released.
+ */
+struct anno_shape_preview_t
 {
-    cairo_t *cr = nullptr;
-    cairo_surface_t *cairo_surface;
-    std::unique_ptr<simple_texture_t> texture;
+    /* The node of the workspace the shape is drawn on, null when inactive */
+    wf::scene::node_t *node = nullptr;
+    anno_stroke_store_t shape;
+    OpenGL::program_t program;
+
+    wf::geometry_t get_bbox()
+    {
+        return shape.get_bbox(shape.strokes.back());
+    }
+
+    /* Renders the shape, with the drawing placed at origin */
+    void render(const wf::render_target_t& target, wf::point_t origin)
+    {
+        auto& stroke = shape.strokes.back();
+        auto p0   = shape.point(stroke, 0);
+        auto p1   = shape.point(stroke, 1);
+        auto bbox = get_bbox();
+        GLfloat x1 = bbox.x + origin.x;
+        GLfloat y1 = bbox.y + origin.y;
+        GLfloat x2 = x1 + bbox.width;
+        GLfloat y2 = y1 + bbox.height;
+        GLfloat vertices[] = {
+            x1, y1, x2, y1, x2, y2,
+            x1, y1, x2, y2, x1, y2,
+        };
+
+        program.use(wf::TEXTURE_TYPE_RGBA);
+        program.uniformMatrix4f("mvp", wf::gles::render_target_orthographic_projection(target));
+        program.uniform1i("shape", stroke.method);
+        program.uniform2f("p0", p0.x + origin.x, p0.y + origin.y);
+        program.uniform2f("p1", p1.x + origin.x, p1.y + origin.y);
+        program.uniform1f("half_width", stroke.width / 2);
+        program.uniform1f("scale", target.scale);
+        program.uniform4f("color",
+            glm::vec4(stroke.color.r, stroke.color.g, stroke.color.b, stroke.color.a));
+        program.attrib_pointer("position", 2, 0, vertices);
+        GL_CALL(glEnable(GL_BLEND));
+        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 6));
+        program.deactivate();
+    }
 };
 
 namespace wf
@@ -79,18 +1813,19 @@ class simple_node_render_instance_t : public render_instance_t
 
     node_t *self;
     damage_callback push_to_parent;
-    std::shared_ptr<anno_ws_overlay> overlay, shape_overlay;
+    std::shared_ptr<anno_ws_overlay> overlay;
+    std::shared_ptr<anno_shape_preview_t> preview;
     wf::geometry_t *geometry;
 
   public:
     simple_node_render_instance_t(node_t *self, damage_callback push_dmg,
         wf::geometry_t *geometry, std::shared_ptr<anno_ws_overlay> overlay,
-        std::shared_ptr<anno_ws_overlay> shape_overlay)
+        std::shared_ptr<anno_shape_preview_t> preview)
     {
         this->geometry = geometry;
         this->self     = self;
         this->overlay  = overlay;
-        this->shape_overlay  = shape_overlay;
+        this->preview  = preview;
         this->push_to_parent = push_dmg;
         self->connect(&on_node_damaged);
     }
@@ -98,11 +1833,18 @@ class simple_node_render_instance_t : public render_instance_t
     void schedule_instructions(std::vector<render_instruction_t>& instructions,
         const wf::render_target_t& target, wf::regionf_t& damage) override
     {
+        auto our_damage = damage & self->get_bounding_box();
+        if (!our_damage.empty())
+        {
+            /* Rebuild the raster cache if it was dropped */
+            overlay->ensure_rasterized();
+        }
+
         // We want to render ourselves only, the node does not have children
         instructions.push_back(render_instruction_t{
                         .instance = this,
                         .target   = target,
-                        .damage   = damage & self->get_bounding_box(),
+                        .damage   = our_damage,
                     });
     }
 
@@ -117,16 +1859,10 @@ class simple_node_render_instance_t : public render_instance_t
             for (auto& box : data.damage)
             {
                 wf::gles::render_target_logic_scissor(data.target, box);
-                if (ol->cr)
-                {
-                    OpenGL::render_texture(wf::gles_texture_t{ol->texture->tex}, data.target, og,
-                        glm::vec4(1.0), OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
-                }
-
-                if (shape_overlay->cr)
+                ol->render(data.target, {og.x, og.y}, box);
+                if (preview->node == self)
                 {
-                    OpenGL::render_texture(wf::gles_texture_t{shape_overlay->texture->tex}, data.target, og,
-                        glm::vec4(1.0), OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+                    preview->render(data.target, {og.x, og.y});
                 }
             }
         });
@@ -139,15 +1875,17 @@ class simple_node_t : public node_t
     wf::geometry_t geometry;
 
   public:
-    std::shared_ptr<anno_ws_overlay> overlay, shape_overlay;
-    simple_node_t(int x, int y, int w, int h) : node_t(false)
+    std::shared_ptr<anno_ws_overlay> overlay;
+    std::shared_ptr<anno_shape_preview_t> preview;
+    simple_node_t(int x, int y, int w, int h, std::shared_ptr<anno_shape_preview_t> preview,
+        std::shared_ptr<anno_rasterizer_t> rasterizer) : node_t(false)
     {
         this->geometry.x     = x;
         this->geometry.y     = y;
         this->geometry.width = w;
         this->geometry.height = h;
-        overlay = std::make_shared<anno_ws_overlay>();
-        shape_overlay = std::make_shared<anno_ws_overlay>();
+        overlay = std::make_shared<anno_ws_overlay>(rasterizer);
+        this->preview = preview;
     }
 
     void gen_render_instances(std::vector<render_instance_uptr>& instances,
@@ -158,7 +1896,7 @@ class simple_node_t : public node_t
         // this simple nodes does not need any transformations, so the push_damage
         // callback is just passed along.
         instances.push_back(std::make_unique<simple_node_render_instance_t>(
-            this, push_damage, &geometry, overlay, shape_overlay));
+            this, push_damage, &geometry, overlay, preview));
     }
 
     void do_push_damage(wf::regionf_t updated_region)
@@ -188,9 +1926,10 @@ class simple_node_t : public node_t
 };
 
 std::shared_ptr<simple_node_t> add_simple_node(wf::output_t *output, int x, int y,
-    int w, int h)
+    int w, int h, std::shared_ptr<anno_shape_preview_t> preview,
+    std::shared_ptr<anno_rasterizer_t> rasterizer)
 {
-    auto subnode = std::make_shared<simple_node_t>(x, y, w, h);
+    auto subnode = std::make_shared<simple_node_t>(x, y, w, h, preview, rasterizer);
     wf::scene::add_front(output->node_for_layer(wf::scene::layer::OVERLAY), subnode);
     return subnode;
 }
@@ -201,7 +1940,19 @@ class wayfire_annotate_screen : public wf::per_output_plugin_instance_t, public
     wf::geometry_t last_bbox;
     annotate_draw_method draw_method;
     wf::pointf_t grab_point, last_cursor;
+    /* Whether a freehand stroke is being drawn, and its last point which
+     * has been rasterized */
+    bool freehand = false;
+    uint32_t drawn_point = 0;
+    /* A released shape stays previewed until the rasterizer has drawn it,
+     * which is when the job with this serial is done */
+    uint64_t preview_serial = 0;
+    std::shared_ptr<anno_shape_preview_t> preview;
+    std::shared_ptr<anno_rasterizer_t> rasterizer;
     std::vector<std::vector<std::shared_ptr<simple_node_t>>> overlays;
+    std::deque<anno_history_entry_t> undo_history, redo_history;
+    /* Memory held by both histories */
+    size_t history_size = 0;
     wf::option_wrapper_t<std::string> method{"annotate/method"};
     wf::option_wrapper_t<double> line_width{"annotate/line_width"};
     wf::option_wrapper_t<bool> shapes_from_center{"annotate/from_center"};
@@ -209,6 +1960,13 @@ class wayfire_annotate_screen : public wf::per_output_plugin_instance_t, public
     wf::option_wrapper_t<wf::buttonbinding_t> draw_binding{"annotate/draw"};
     wf::option_wrapper_t<wf::activatorbinding_t> clear_binding{
         "annotate/clear_workspace"};
+    wf::option_wrapper_t<wf::activatorbinding_t> undo_binding{"annotate/undo"};
+    wf::option_wrapper_t<wf::activatorbinding_t> redo_binding{"annotate/redo"};
+    wf::option_wrapper_t<int> undo_memory{"annotate/undo_memory"};
+    wf::option_wrapper_t<bool> persist{"annotate/persist"};
+    wf::option_wrapper_t<std::string> persist_directory{"annotate/persist_directory"};
+    /* Where changes are saved to, null when not saving */
+    std::shared_ptr<anno_persist_file_t> persist_file;
     std::unique_ptr<wf::input_grab_t> input_grab;
     wf::plugin_activation_data_t grab_interface{
         .name = "annotate",
@@ -231,26 +1989,63 @@ class wayfire_annotate_screen : public wf::per_output_plugin_instance_t, public
             overlays[x].resize(wsize.height);
         }
 
+        rasterizer = std::make_shared<anno_rasterizer_t>();
+        rasterizer->on_updates = [=] (std::vector<anno_tile_update_t>& updates, uint64_t serial)
+        {
+            apply_updates(updates, serial);
+        };
+
+        preview = std::make_shared<anno_shape_preview_t>();
+        wf::gles::run_in_context([&]
+        {
+            preview->program.set_simple(OpenGL::compile_program(shape_vertex_shader,
+                shape_fragment_shader));
+        });
+
         auto og = output->get_relative_geometry();
         for (int x = 0; x < wsize.width; x++)
         {
             for (int y = 0; y < wsize.height; y++)
             {
                 overlays[x][y] = add_simple_node(output, x * og.width, y * og.height,
-                    og.width, og.height);
+                    og.width, og.height, preview, rasterizer);
             }
         }
 
+        update_geometry();
+        if (persist)
+        {
+            start_persisting();
+        }
+
+        persist.set_callback(persist_changed);
+        persist_directory.set_callback(persist_changed);
         output->connect(&output_config_changed);
         output->connect(&viewport_changed);
         method.set_callback(method_changed);
         output->add_button(draw_binding, &draw_begin);
         output->add_activator(clear_binding, &clear_workspace);
+        output->add_activator(undo_binding, &undo_cb);
+        output->add_activator(redo_binding, &redo_cb);
+        undo_memory.set_callback(undo_memory_changed);
         input_grab = std::make_unique<wf::input_grab_t>(this->grab_interface.name, output, nullptr, this,
             nullptr);
         method_changed();
     }
 
+    void handle_pointer_motion(wf::pointf_t pointer_position, uint32_t time_ms) override
+    {
+        add_sample(pointer_position);
+    }
+
+    /* Tablet tools move the cursor as well, but their events may not reach
+     * the grab as pointer motion */
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_tablet_tool_axis_event>> on_tablet_axis =
+        [=] (wf::post_input_event_signal<wlr_tablet_tool_axis_event>*)
+    {
+        add_sample(wf::get_core().get_cursor_position());
+    };
+
     void handle_pointer_button(const wlr_pointer_button_event& event) override
     {
         if ((event.button == button) && (event.state == WL_POINTER_BUTTON_STATE_RELEASED))
@@ -279,6 +2074,40 @@ class wayfire_annotate_screen : public wf::per_output_plugin_instance_t, public
         }
     };
 
+    /* Uploads the tiles drawn by the rasterizer and damages them */
+    void apply_updates(std::vector<anno_tile_update_t>& updates, uint64_t serial)
+    {
+        for (auto& update : updates)
+        {
+            for (auto& row : overlays)
+            {
+                for (auto& node : row)
+                {
+                    if ((node->overlay->drawing != update.drawing) || !node->overlay->apply(update))
+                    {
+                        continue;
+                    }
+
+                    auto origin = node->get_bounding_box();
+                    auto damage = update.damage;
+                    damage.x += origin.x;
+                    damage.y += origin.y;
+                    node->do_push_damage(wf::regionf_t(damage));
+                }
+            }
+        }
+
+        if (preview_serial && (serial >= preview_serial))
+        {
+            preview_serial = 0;
+            if (!input_grab->is_grabbed())
+            {
+                preview->node = nullptr;
+                get_node_overlay()->do_push_damage(wf::regionf_t(last_bbox));
+            }
+        }
+    }
+
     std::shared_ptr<simple_node_t> get_node_overlay()
     {
         auto ws = output->wset()->get_current_workspace();
@@ -289,465 +2118,816 @@ class wayfire_annotate_screen : public wf::per_output_plugin_instance_t, public
     {
         auto ws = output->wset()->get_current_workspace();
 
+        overlays[ws.x][ws.y]->overlay->ensure_restored();
         return overlays[ws.x][ws.y]->overlay;
     }
 
-    std::shared_ptr<anno_ws_overlay> get_shape_overlay()
+    std::string get_persist_path()
     {
-        auto ws = output->wset()->get_current_workspace();
+        std::string dir = persist_directory;
+        if (dir.empty())
+        {
+            const char *data_home = getenv("XDG_DATA_HOME");
+            const char *home = getenv("HOME");
+            dir  = data_home ? data_home : std::string(home ? home : "") + "/.local/share";
+            dir += "/wayfire/annotate";
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        return dir + "/" + output->to_string() + ".wfanno";
+    }
+
+    /*
+     * Starts saving the drawings. If nothing is drawn yet, the saved drawings
+     * are restored, each workspace when it is first used. Otherwise, the
+     * saved drawings are replaced by the current ones.
+     */
+    void start_persisting()
+    {
+        bool empty = true;
+        for (auto& row : overlays)
+        {
+            for (auto& node : row)
+            {
+                empty &= node->overlay->strokes.empty() && !node->overlay->saved;
+            }
+        }
+
+        auto path = get_persist_path();
+        auto file = std::make_shared<anno_persist_file_t>();
+        if (!empty)
+        {
+            std::vector<std::pair<wf::point_t, const anno_stroke_store_t*>> workspaces;
+            for (int x = 0; x < (int)overlays.size(); x++)
+            {
+                for (int y = 0; y < (int)overlays[x].size(); y++)
+                {
+                    overlays[x][y]->overlay->ensure_restored();
+                    workspaces.push_back({{x, y}, &overlays[x][y]->overlay->strokes});
+                }
+            }
+
+            if (!file->write_all(path, workspaces))
+            {
+                LOGE("annotate: failed to save to ", path);
+                return;
+            }
+
+            persist_file = file;
+            return;
+        }
+
+        bool writable = file->open(path);
+        for (auto& [ws, records] : file->index)
+        {
+            if ((ws.first >= 0) && (ws.first < (int)overlays.size()) &&
+                (ws.second >= 0) && (ws.second < (int)overlays[ws.first].size()) && !records.empty())
+            {
+                auto ol = overlays[ws.first][ws.second]->overlay;
+                ol->saved = file;
+                ol->saved_strokes = records;
+            }
+        }
+
+        if (!writable)
+        {
+            LOGE("annotate: failed to open ", path, " for saving");
+            return;
+        }
+
+        persist_file = file;
+        output->render->damage_whole();
+    }
+
+    wf::config::option_base_t::updated_callback_t persist_changed = [=] ()
+    {
+        if (persist_file)
+        {
+            persist_file->close();
+            persist_file.reset();
+        }
 
-        return overlays[ws.x][ws.y]->shape_overlay;
+        if (persist)
+        {
+            start_persisting();
+        }
+    };
+
+    /* Places the drawings of all workspaces relative to the current one,
+     * and sizes them to the output */
+    void update_geometry()
+    {
+        auto wsize = output->wset()->get_workspace_grid_size();
+        auto og    = output->get_relative_geometry();
+        auto cws   = output->wset()->get_current_workspace();
+
+        for (int x = 0; x < wsize.width; x++)
+        {
+            for (int y = 0; y < wsize.height; y++)
+            {
+                overlays[x][y]->set_position((x - cws.x) * og.width,
+                    (y - cws.y) * og.height);
+                overlays[x][y]->set_size(og.width, og.height);
+                overlays[x][y]->overlay->set_size(og.width, og.height, output->handle->scale);
+            }
+        }
     }
 
     wf::signal::connection_t<wf::workspace_changed_signal> viewport_changed{[this] (wf::
                                                                                     workspace_changed_signal*
                                                                                     ev)
         {
-            auto wsize = output->wset()->get_workspace_grid_size();
-            auto og    = output->get_relative_geometry();
-            auto nvp   = ev->new_viewport;
+            auto wsize = output->wset()->get_workspace_grid_size();
+            auto og    = output->get_relative_geometry();
+            auto nvp   = ev->new_viewport;
+
+            for (int x = 0; x < wsize.width; x++)
+            {
+                for (int y = 0; y < wsize.height; y++)
+                {
+                    overlays[x][y]->set_position((x - nvp.x) * og.width,
+                        (y - nvp.y) * og.height);
+
+                    /* Only the current workspace keeps its drawing rasterized */
+                    if ((x != nvp.x) || (y != nvp.y))
+                    {
+                        overlays[x][y]->overlay->release();
+                    }
+                }
+            }
+
+            output->render->damage_whole();
+        }
+    };
+
+    wf::pointf_t to_local(wf::pointf_t point)
+    {
+        auto og = output->get_layout_geometry();
+        return {point.x - og.x, point.y - og.y};
+    }
+
+    wf::button_callback draw_begin = [=] (wf::buttonbinding_t btn)
+    {
+        output->render->add_effect(&frame_pre_paint, wf::OUTPUT_EFFECT_DAMAGE);
+        output->render->damage_whole();
+        grab_point = last_cursor = wf::get_core().get_cursor_position();
+        button     = btn.get_button();
+
+        if (draw_method == ANNOTATE_METHOD_DRAW)
+        {
+            auto ol = get_current_overlay();
+            ol->ensure_rasterized();
+            ol->strokes.begin_stroke(ANNOTATE_METHOD_DRAW, line_width, stroke_color);
+            ol->strokes.add_point(to_local(grab_point));
+            freehand    = true;
+            drawn_point = 0;
+            wf::get_core().connect(&on_tablet_axis);
+        }
+
+        grab();
+
+        return false;
+    };
+
+    void draw_end()
+    {
+        auto ol = get_current_overlay();
+
+        output->render->rem_effect(&frame_pre_paint);
+        ungrab();
+
+        if (freehand)
+        {
+            draw_freehand(true);
+            freehand = false;
+            on_tablet_axis.disconnect();
+            push_history(output->wset()->get_current_workspace(), ANNOTATE_HISTORY_ADD, 1);
+            return;
+        }
+
+        set_shape(wf::get_core().get_cursor_position());
+        auto& shape  = preview->shape;
+        auto& stroke = shape.strokes.back();
+        ol->ensure_rasterized();
+        ol->strokes.add_stroke(shape, stroke);
+        preview_serial = ol->draw_stroke(shape, stroke, 0, 1);
+        shape_drawn(shape.get_bbox(stroke), true);
+        push_history(output->wset()->get_current_workspace(), ANNOTATE_HISTORY_ADD, 1);
+    }
+
+    void clear(wf::point_t ws)
+    {
+        auto ol = overlays[ws.x][ws.y]->overlay;
+
+        ol->ensure_restored();
+        if (!ol->strokes.empty())
+        {
+            push_history(ws, ANNOTATE_HISTORY_CLEAR, 0, std::move(ol->strokes));
+        }
+
+        ol->clear();
+
+        output->render->damage_whole();
+    }
+
+    wf::signal::connection_t<wf::output_configuration_changed_signal> output_config_changed{[this] (wf::
+                                                                                                    output_configuration_changed_signal
+                                                                                                    *ev)
+        {
+            if (!ev->changed_fields)
+            {
+                return;
+            }
+
+            if (ev->changed_fields & wf::OUTPUT_SOURCE_CHANGE)
+            {
+                return;
+            }
+
+            /* The strokes are kept, and rasterized again at the new size and
+             * scale when they are shown */
+            update_geometry();
+            output->render->damage_whole();
+        }
+    };
+
+    wf::activator_callback clear_workspace = [=] (auto)
+    {
+        clear(output->wset()->get_current_workspace());
+
+        return true;
+    };
+
+    /* Adds a point to the freehand stroke for every input event, so fast
+     * strokes and high rate tablets keep their shape */
+    void add_sample(wf::pointf_t point)
+    {
+        auto& strokes = get_current_overlay()->strokes;
+        if (!freehand || strokes.empty() || ((point.x == last_cursor.x) && (point.y == last_cursor.y)))
+        {
+            return;
+        }
+
+        strokes.add_point(to_local(point));
+        last_cursor = point;
+        output->render->schedule_redraw();
+    }
+
+    /* Records a change to a workspace, which drops everything that could be
+     * redone, and saves it */
+    void push_history(wf::point_t ws, anno_history_action action, uint32_t count,
+        anno_stroke_store_t strokes = {}, std::vector<uint32_t> indices = {})
+    {
+        redo_history.clear();
+        if (persist_file && (action == ANNOTATE_HISTORY_ADD))
+        {
+            auto& added = overlays[ws.x][ws.y]->overlay->strokes;
+            persist_file->write_strokes(ws, added, added.strokes.size() - count);
+        } else if (persist_file && (action == ANNOTATE_HISTORY_REMOVE))
+        {
+            persist_file->write_remove(ws, indices);
+        } else if (persist_file)
+        {
+            persist_file->write_clear(ws);
+        }
+
+        undo_history.push_back({action, ws, count, std::move(strokes), std::move(indices)});
+        trim_history();
+    }
+
+    /* Drops the oldest changes while the history is over its memory budget */
+    void trim_history()
+    {
+        history_size = 0;
+        for (auto& entry : undo_history)
+        {
+            history_size += entry.memory_size();
+        }
+
+        for (auto& entry : redo_history)
+        {
+            history_size += entry.memory_size();
+        }
+
+        size_t budget = std::max((int)undo_memory, 0) * 1024ul;
+        while ((history_size > budget) && !undo_history.empty())
+        {
+            history_size -= undo_history.front().memory_size();
+            undo_history.pop_front();
+        }
+
+        while ((history_size > budget) && !redo_history.empty())
+        {
+            history_size -= redo_history.front().memory_size();
+            redo_history.pop_front();
+        }
+    }
+
+    wf::config::option_base_t::updated_callback_t undo_memory_changed = [=] ()
+    {
+        trim_history();
+    };
+
+    /* Box covering the given strokes of store, or all of them if not
+     * indexed */
+    wf::geometry_t get_bbox(const anno_stroke_store_t& store,
+        const std::vector<uint32_t>& indices, bool indexed)
+    {
+        wf::geometry_t bbox = {0, 0, 0, 0};
+        size_t count = indexed ? indices.size() : store.strokes.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            auto b = store.get_bbox(store.strokes[indexed ? indices[i] : i]);
+            bbox = (i == 0) ? b : boxes_union(bbox, b);
+        }
+
+        return bbox;
+    }
+
+    /*
+     * Reverts the last change in from when undoing, or repeats it when
+     * redoing, and moves it to the other history. Only the area of the
+     * changed strokes is rasterized again, unless a whole workspace was
+     * cleared or restored.
+     */
+    bool apply_history(std::deque<anno_history_entry_t>& from,
+        std::deque<anno_history_entry_t>& to, bool undo)
+    {
+        if (!input_grab || overlays.empty() || from.empty() || input_grab->is_grabbed())
+        {
+            return false;
+        }
+
+        auto entry = std::move(from.back());
+        from.pop_back();
+
+        auto ol = overlays[entry.workspace.x][entry.workspace.y]->overlay;
+        ol->ensure_restored();
+        if (entry.action == ANNOTATE_HISTORY_CLEAR)
+        {
+            std::swap(ol->strokes, entry.strokes);
+            ol->release();
+            output->render->damage_whole();
+            if (persist_file && ol->strokes.empty())
+            {
+                persist_file->write_clear(entry.workspace);
+            } else if (persist_file)
+            {
+                persist_file->write_strokes(entry.workspace, ol->strokes, 0);
+            }
+        } else if (entry.action == ANNOTATE_HISTORY_REMOVE)
+        {
+            auto& store = undo ? entry.strokes : ol->strokes;
+            auto bbox   = get_bbox(store, entry.indices, !undo);
+            if (undo)
+            {
+                ol->strokes.insert_strokes(entry.indices, entry.strokes);
+                entry.strokes = {};
+            } else
+            {
+                ol->strokes.remove_strokes(entry.indices, entry.strokes);
+            }
+
+            ol->redraw(bbox);
+            if (persist_file && undo)
+            {
+                persist_file->write_clear(entry.workspace);
+                persist_file->write_strokes(entry.workspace, ol->strokes, 0);
+            } else if (persist_file)
+            {
+                persist_file->write_remove(entry.workspace, entry.indices);
+            }
+        } else
+        {
+            auto& store = undo ? ol->strokes : entry.strokes;
+            std::vector<uint32_t> added;
+            for (size_t i = store.strokes.size() - entry.count; i < store.strokes.size(); i++)
+            {
+                added.push_back(i);
+            }
 
-            for (int x = 0; x < wsize.width; x++)
+            auto bbox = get_bbox(store, added, true);
+            if (undo)
             {
-                for (int y = 0; y < wsize.height; y++)
+                ol->strokes.move_last_strokes(entry.count, entry.strokes);
+                ol->redraw(bbox);
+                if (persist_file)
                 {
-                    overlays[x][y]->set_position((x - nvp.x) * og.width,
-                        (y - nvp.y) * og.height);
+                    persist_file->write_remove(entry.workspace, added);
+                }
+            } else
+            {
+                entry.strokes.move_last_strokes(entry.count, ol->strokes);
+                entry.strokes = {};
+                ol->draw_strokes(ol->strokes.strokes.size() - entry.count);
+                if (persist_file)
+                {
+                    persist_file->write_strokes(entry.workspace, ol->strokes,
+                        ol->strokes.strokes.size() - entry.count);
                 }
             }
-
-            output->render->damage_whole();
         }
-    };
-
-    wf::button_callback draw_begin = [=] (wf::buttonbinding_t btn)
-    {
-        output->render->add_effect(&frame_pre_paint, wf::OUTPUT_EFFECT_DAMAGE);
-        output->render->damage_whole();
-        grab_point = last_cursor = wf::get_core().get_cursor_position();
-        button     = btn.get_button();
 
-        grab();
-
-        return false;
-    };
+        to.push_back(std::move(entry));
+        trim_history();
+        return true;
+    }
 
-    void draw_end()
+    static bool json_is_number(const wf::json_t& value)
     {
-        auto ol = get_current_overlay();
-        auto shape_overlay = get_shape_overlay();
+        return value.is_double() || value.is_int64();
+    }
 
-        output->render->rem_effect(&frame_pre_paint);
-        overlay_destroy(shape_overlay);
-        ungrab();
+    static double json_as_number(const wf::json_t& value)
+    {
+        return value.is_double() ? value.as_double() : value.as_int64();
+    }
 
-        switch (draw_method)
+    static bool json_get_point(const wf::json_t& value, wf::pointf_t& point)
+    {
+        size_t x = 0, y = 1;
+        if (!value.is_array() || (value.size() != 2) ||
+            !json_is_number(value[x]) || !json_is_number(value[y]))
         {
-          case ANNOTATE_METHOD_LINE:
-            cairo_draw_line(ol, wf::get_core().get_cursor_position());
-            break;
+            return false;
+        }
 
-          case ANNOTATE_METHOD_RECTANGLE:
-            cairo_draw_rectangle(ol, last_cursor);
-            break;
+        point = {json_as_number(value[x]), json_as_number(value[y])};
+        return true;
+    }
 
-          case ANNOTATE_METHOD_CIRCLE:
-            cairo_draw_circle(ol, last_cursor);
-            break;
+    /* The workspace of an IPC request, the current one by default */
+    std::optional<wf::point_t> get_ipc_workspace(const wf::json_t& data)
+    {
+        auto ws = output->wset()->get_current_workspace();
+        if (data.has_member("workspace"))
+        {
+            auto value = data["workspace"];
+            if (!value.is_object() || !value.has_member("x") || !value.has_member("y") ||
+                !value["x"].is_int64() || !value["y"].is_int64())
+            {
+                return {};
+            }
 
-          default:
-            break;
+            ws = {(int)value["x"].as_int64(), (int)value["y"].as_int64()};
         }
-    }
 
-    void overlay_clear(std::shared_ptr<anno_ws_overlay> ol)
-    {
-        if (!ol->cr)
+        if ((ws.x < 0) || (ws.x >= (int)overlays.size()) ||
+            (ws.y < 0) || (ws.y >= (int)overlays[ws.x].size()))
         {
-            return;
+            return {};
         }
 
-        cairo_clear(ol->cr);
+        return ws;
     }
 
-    void overlay_destroy(std::shared_ptr<anno_ws_overlay> ol)
+    /* Adds a primitive of an annotate/draw request to store, or returns an
+     * error message */
+    std::string add_primitive(const wf::json_t& primitive, uint32_t tag, anno_stroke_store_t& store)
     {
-        if (!ol->cr)
+        if (!primitive.is_object() || !primitive.has_member("type") || !primitive["type"].is_string())
         {
-            return;
+            return "Each primitive needs a type.";
         }
 
-        wf::gles::run_in_context([&]
+        auto get = [&] (const std::string& key, double& value)
         {
-            if (ol->texture && (ol->texture->tex != (GLuint) - 1))
+            if (!primitive.has_member(key) || !json_is_number(primitive[key]))
             {
-                glDeleteTextures(1, &ol->texture->tex);
+                return false;
             }
-        });
 
-        ol->texture.reset();
-        cairo_surface_destroy(ol->cairo_surface);
-        cairo_destroy(ol->cr);
-        ol->cr = nullptr;
-    }
+            value = json_as_number(primitive[key]);
+            return true;
+        };
 
-    void clear()
-    {
-        auto ol = get_current_overlay();
+        wf::color_t color = stroke_color;
+        double width = line_width;
+        if (primitive.has_member("color"))
+        {
+            auto parsed = primitive["color"].is_string() ?
+                wf::option_type::from_string<wf::color_t>(primitive["color"].as_string()) : std::nullopt;
+            if (!parsed)
+            {
+                return "Invalid color.";
+            }
 
-        overlay_destroy(ol);
+            color = parsed.value();
+        }
 
-        output->render->damage_whole();
-    }
+        if (primitive.has_member("line-width") && (!get("line-width", width) || (width <= 0)))
+        {
+            return "Invalid line-width.";
+        }
 
-    wf::signal::connection_t<wf::output_configuration_changed_signal> output_config_changed{[this] (wf::
-                                                                                                    output_configuration_changed_signal
-                                                                                                    *ev)
+        auto type = primitive["type"].as_string();
+        double x, y, w, h, radius;
+        if (type == "rect")
         {
-            if (!ev->changed_fields)
+            if (!get("x", x) || !get("y", y) || !get("width", w) || !get("height", h))
             {
-                return;
+                return "A rect needs x, y, width and height.";
             }
 
-            if (ev->changed_fields & wf::OUTPUT_SOURCE_CHANGE)
+            store.begin_stroke(ANNOTATE_METHOD_RECTANGLE, width, color, tag);
+            store.add_point({x, y});
+            store.add_point({x + w, y + h});
+        } else if (type == "circle")
+        {
+            if (!get("x", x) || !get("y", y) || !get("radius", radius))
             {
-                return;
+                return "A circle needs x, y and radius.";
             }
 
-            clear();
-        }
-    };
+            store.begin_stroke(ANNOTATE_METHOD_CIRCLE, width, color, tag);
+            store.add_point({x, y});
+            store.add_point({x + radius, y});
+        } else if ((type == "line") || (type == "polyline"))
+        {
+            bool is_line = (type == "line");
+            auto points  = primitive.has_member("points") ? primitive["points"] : wf::json_t::null();
+            size_t count = points.is_array() ? points.size() : 0;
+            if ((count < 2) || (is_line && (count != 2)))
+            {
+                return is_line ? "A line needs two points." : "A polyline needs at least two points.";
+            }
 
-    wf::activator_callback clear_workspace = [=] (auto)
-    {
-        clear();
+            std::vector<wf::pointf_t> parsed(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (!json_get_point(points[i], parsed[i]))
+                {
+                    return "Points must be [x, y] pairs.";
+                }
+            }
 
-        return true;
-    };
+            store.begin_stroke(is_line ? ANNOTATE_METHOD_LINE : ANNOTATE_METHOD_POLYLINE, width, color, tag);
+            for (auto& point : parsed)
+            {
+                store.add_point(point);
+            }
+        } else
+        {
+            return "Unknown primitive type " + type + ".";
+        }
+
+        return "";
+    }
 
-    void cairo_init(std::shared_ptr<anno_ws_overlay> ol)
+    /*
+     * Draws a batch of primitives on a workspace, as a single change which
+     * is rasterized and uploaded in one pass.
+     */
+    wf::json_t ipc_draw(const wf::json_t& data)
     {
-        auto og = output->get_relative_geometry();
+        if (!input_grab)
+        {
+            return wf::ipc::json_error("Annotate is not supported on this renderer.");
+        }
 
-        if (ol->cr)
+        auto ws = get_ipc_workspace(data);
+        if (!ws)
         {
-            return;
+            return wf::ipc::json_error("Invalid workspace.");
         }
 
-        ol->cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, og.width,
-            og.height);
-        get_node_overlay()->set_size(og.width, og.height);
-        ol->cr = cairo_create(ol->cairo_surface);
+        if (input_grab->is_grabbed())
+        {
+            return wf::ipc::json_error("The output is being drawn on.");
+        }
 
-        ol->texture = std::make_unique<simple_texture_t>();
-    }
+        auto tag = wf::ipc::json_get_optional_string(data, "tag").value_or("");
+        if (tag.size() > 255)
+        {
+            return wf::ipc::json_error("The tag is too long.");
+        }
 
-    void cairo_clear(cairo_t *cr)
-    {
-        cairo_set_source_rgba(cr, 0, 0, 0, 0);
-        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-        cairo_paint(cr);
-    }
+        if (!data.has_member("primitives") || !data["primitives"].is_array())
+        {
+            return wf::ipc::json_error("Missing primitives array.");
+        }
 
-    void cairo_surface_upload_to_texture_with_damage(
-        cairo_surface_t *surface, simple_texture_t& buffer, wlr_box damage_box)
-    {
-        auto src = cairo_image_surface_get_data(surface);
-        buffer.width  = cairo_image_surface_get_width(surface);
-        buffer.height = cairo_image_surface_get_height(surface);
+        anno_stroke_store_t batch;
+        auto primitives = data["primitives"];
+        uint32_t tag_id = anno_tags().ref(tag);
+        std::string error;
+        for (size_t i = 0; (i < primitives.size()) && error.empty(); i++)
+        {
+            error = add_primitive(primitives[i], tag_id, batch);
+            if (!error.empty())
+            {
+                error = "Primitive " + std::to_string(i) + ": " + error;
+            }
+        }
 
-        wf::gles::run_in_context([&]
+        /* The strokes of the batch hold their own references */
+        anno_tags().unref(tag_id);
+        if (!error.empty())
         {
-            if (buffer.tex == (GLuint) - 1)
-            {
-                GL_CALL(glGenTextures(1, &buffer.tex));
-                GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
-                GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
-                    GL_LINEAR));
-                GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR));
-                GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
-                GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
-                GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-                    buffer.width, buffer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src));
-                return;
+            return wf::ipc::json_error(error);
+        }
+
+        if (!batch.empty())
+        {
+            auto ol = overlays[ws->x][ws->y]->overlay;
+            ol->ensure_restored();
+            size_t first = ol->strokes.strokes.size();
+            for (auto& stroke : batch.strokes)
+            {
+                ol->strokes.add_stroke(batch, stroke);
             }
 
-            auto og = output->get_relative_geometry();
-            GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
-            GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, buffer.width));
-            GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS,
-                wf::clamp(damage_box.y, 0, og.height - damage_box.height)));
-            GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS,
-                wf::clamp(damage_box.x, 0, og.width - damage_box.width)));
-
-            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0,
-                wf::clamp(damage_box.x, 0, og.width - damage_box.width),
-                wf::clamp(damage_box.y, 0, og.height - damage_box.height),
-                damage_box.width, damage_box.height,
-                GL_RGBA, GL_UNSIGNED_BYTE, src));
-
-            GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
-            GL_CALL(glPixelStorei(GL_UNPACK_SKIP_ROWS, 0));
-            GL_CALL(glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0));
-        });
+            ol->draw_strokes(first);
+            push_history(*ws, ANNOTATE_HISTORY_ADD, batch.strokes.size());
+        }
+
+        auto response = wf::ipc::json_ok();
+        response["count"] = (uint64_t)batch.strokes.size();
+        return response;
     }
 
-    void cairo_draw(std::shared_ptr<anno_ws_overlay> ol, wf::pointf_t from,
-        wf::pointf_t to)
+    /*
+     * Removes the strokes with a tag from a workspace, or from all of them
+     * if none is given, or clears a whole workspace if no tag is given.
+     */
+    wf::json_t ipc_clear(const wf::json_t& data)
     {
-        auto og = output->get_layout_geometry();
+        if (!input_grab)
+        {
+            return wf::ipc::json_error("Annotate is not supported on this renderer.");
+        }
 
-        from.x -= og.x;
-        from.y -= og.y;
-        to.x   -= og.x;
-        to.y   -= og.y;
+        if (input_grab->is_grabbed())
+        {
+            return wf::ipc::json_error("The output is being drawn on.");
+        }
+
+        auto tag = wf::ipc::json_get_optional_string(data, "tag");
+        auto ws  = get_ipc_workspace(data);
+        if (!ws)
+        {
+            return wf::ipc::json_error("Invalid workspace.");
+        }
 
-        cairo_init(ol);
-        cairo_t *cr = ol->cr;
+        if (!tag.has_value())
+        {
+            clear(*ws);
+            return wf::ipc::json_ok();
+        }
 
-        cairo_set_line_width(cr, line_width);
-        cairo_set_source_rgba(cr,
-            wf::color_t(stroke_color).r,
-            wf::color_t(stroke_color).g,
-            wf::color_t(stroke_color).b,
-            wf::color_t(stroke_color).a);
-        cairo_move_to(cr, from.x, from.y);
-        cairo_line_to(cr, to.x, to.y);
-        cairo_stroke(cr);
+        uint64_t removed = 0;
+        for (int x = 0; x < (int)overlays.size(); x++)
+        {
+            for (int y = 0; y < (int)overlays[x].size(); y++)
+            {
+                if (data.has_member("workspace") && (*ws != wf::point_t{x, y}))
+                {
+                    continue;
+                }
 
-        wf::geometry_t bbox;
-        int padding = line_width + 1;
-        bbox.x     = std::min(from.x, to.x) - padding;
-        bbox.y     = std::min(from.y, to.y) - padding;
-        bbox.width = std::abs(from.x - to.x) + padding * 2;
-        bbox.height = std::abs(from.y - to.y) + padding * 2;
-        get_node_overlay()->do_push_damage(wf::regionf_t(bbox));
-        cairo_surface_upload_to_texture_with_damage(ol->cairo_surface, *ol->texture,
-            wf::to_integer_box(bbox));
-    }
+                auto ol = overlays[x][y]->overlay;
+                ol->ensure_restored();
+                auto tag_id = anno_tags().find(tag.value());
+                if (!tag_id)
+                {
+                    continue;
+                }
 
-    bool should_damage_last()
-    {
-        auto shape_overlay = get_shape_overlay();
-        return shape_overlay->texture && shape_overlay->texture->tex != (uint32_t)-1;
-    }
+                std::vector<uint32_t> indices;
+                for (uint32_t i = 0; i < ol->strokes.strokes.size(); i++)
+                {
+                    if (ol->strokes.strokes[i].tag == *tag_id)
+                    {
+                        indices.push_back(i);
+                    }
+                }
 
-    void cairo_draw_line(std::shared_ptr<anno_ws_overlay> ol, wf::pointf_t to)
-    {
-        auto og = output->get_layout_geometry();
-        auto shape_overlay = get_shape_overlay();
-        auto from = grab_point;
-
-        from.x -= og.x;
-        from.y -= og.y;
-        to.x   -= og.x;
-        to.y   -= og.y;
-
-        bool damage_last_bbox = should_damage_last();
-        overlay_clear(shape_overlay);
-
-        cairo_init(ol);
-        cairo_t *cr = ol->cr;
-
-        cairo_set_line_width(cr, line_width);
-        cairo_set_source_rgba(cr,
-            wf::color_t(stroke_color).r,
-            wf::color_t(stroke_color).g,
-            wf::color_t(stroke_color).b,
-            wf::color_t(stroke_color).a);
-        cairo_move_to(cr, from.x, from.y);
-        cairo_line_to(cr, to.x, to.y);
-        cairo_stroke(cr);
+                if (indices.empty())
+                {
+                    continue;
+                }
 
-        wf::geometry_t bbox;
-        int padding = line_width + 1;
-        bbox.x     = std::min(from.x, to.x) - padding;
-        bbox.y     = std::min(from.y, to.y) - padding;
-        bbox.width = std::abs(from.x - to.x) + padding * 2;
-        bbox.height = std::abs(from.y - to.y) + padding * 2;
-        output->render->damage(bbox);
-        wf::regionf_t damage_region{bbox};
-        if (damage_last_bbox)
-        {
-            output->render->damage(last_bbox);
-            damage_region |= last_bbox;
+                anno_stroke_store_t strokes;
+                auto bbox = get_bbox(ol->strokes, indices, true);
+                ol->strokes.remove_strokes(indices, strokes);
+                ol->redraw(bbox);
+                removed += indices.size();
+                push_history({x, y}, ANNOTATE_HISTORY_REMOVE, 0, std::move(strokes), std::move(indices));
+            }
         }
 
-        damage_region &= output->get_relative_geometry();
-        auto damage_extents = damage_region.get_extents();
-        auto damage_box     = wf::to_integer_box(wf::geometry_t
-        {damage_extents.x1, damage_extents.y1, damage_extents.x2 - damage_extents.x1,
-            damage_extents.y2 - damage_extents.y1});
-        cairo_surface_upload_to_texture_with_damage(ol->cairo_surface, *ol->texture,
-            damage_box);
-
-        get_node_overlay()->do_push_damage(wf::regionf_t(last_bbox));
-        get_node_overlay()->do_push_damage(wf::regionf_t(bbox));
-        last_bbox = bbox;
+        auto response = wf::ipc::json_ok();
+        response["count"] = removed;
+        return response;
     }
 
-    void cairo_draw_rectangle(std::shared_ptr<anno_ws_overlay> ol, wf::pointf_t to)
+    bool undo()
     {
-        auto og = output->get_layout_geometry();
-        auto shape_overlay = get_shape_overlay();
-        auto from = grab_point;
-        double x, y, w, h;
-
-        from.x -= og.x;
-        from.y -= og.y;
-        to.x   -= og.x;
-        to.y   -= og.y;
+        return apply_history(undo_history, redo_history, true);
+    }
 
-        bool damage_last_bbox = should_damage_last();
-        overlay_clear(shape_overlay);
+    bool redo()
+    {
+        return apply_history(redo_history, undo_history, false);
+    }
 
-        cairo_init(ol);
-        cairo_t *cr = ol->cr;
+    wf::activator_callback undo_cb = [=] (auto)
+    {
+        return undo();
+    };
 
-        w = fabs(from.x - to.x);
-        h = fabs(from.y - to.y);
+    wf::activator_callback redo_cb = [=] (auto)
+    {
+        return redo();
+    };
 
-        if (shapes_from_center)
-        {
-            x  = from.x - w;
-            y  = from.y - h;
-            w *= 2;
-            h *= 2;
-        } else
+    /*
+     * Rasterizes the points added since the last frame as one path, with a
+     * single upload. The segment to the newest point is only drawn once the
+     * stroke ends or the next point is known, as its curve depends on it.
+     */
+    void draw_freehand(bool finish)
+    {
+        auto ol = get_current_overlay();
+        auto& strokes = ol->strokes;
+        if (strokes.empty() || (strokes.strokes.back().point_count < 2))
         {
-            x = std::min(from.x, to.x);
-            y = std::min(from.y, to.y);
+            return;
         }
 
-        cairo_set_line_width(cr, line_width);
-        cairo_set_source_rgba(cr,
-            wf::color_t(stroke_color).r,
-            wf::color_t(stroke_color).g,
-            wf::color_t(stroke_color).b,
-            wf::color_t(stroke_color).a);
-        cairo_rectangle(cr, x, y, w, h);
-        cairo_stroke(cr);
-
-        wf::geometry_t bbox;
-        int padding = line_width + 1;
-        bbox.x     = x - padding;
-        bbox.y     = y - padding;
-        bbox.width = w + padding * 2;
-        bbox.height = h + padding * 2;
-        output->render->damage(bbox);
-        wf::regionf_t damage_region{bbox};
-        if (damage_last_bbox)
+        auto& stroke  = strokes.strokes.back();
+        uint32_t last = stroke.point_count - (finish ? 1 : 2);
+        if (last <= drawn_point)
         {
-            output->render->damage(last_bbox);
-            damage_region |= last_bbox;
+            return;
         }
 
-        damage_region &= output->get_relative_geometry();
-        auto damage_extents = damage_region.get_extents();
-        auto damage_box     = wf::to_integer_box(wf::geometry_t
-        {damage_extents.x1, damage_extents.y1, damage_extents.x2 - damage_extents.x1,
-            damage_extents.y2 - damage_extents.y1});
-        cairo_surface_upload_to_texture_with_damage(ol->cairo_surface, *ol->texture,
-            damage_box);
-
-        get_node_overlay()->do_push_damage(wf::regionf_t(last_bbox));
-        get_node_overlay()->do_push_damage(wf::regionf_t(bbox));
-        last_bbox = bbox;
+        ol->draw_stroke(strokes, stroke, drawn_point, last);
+        drawn_point = last;
     }
 
-    void cairo_draw_circle(std::shared_ptr<anno_ws_overlay> ol, wf::pointf_t to)
+    /* Sets the shape which is drawn from the grab point to the cursor */
+    void set_shape(wf::pointf_t to)
     {
-        auto og = output->get_layout_geometry();
-        auto shape_overlay = get_shape_overlay();
-        auto from = grab_point;
-
-        from.x -= og.x;
-        from.y -= og.y;
-        to.x   -= og.x;
-        to.y   -= og.y;
+        auto& shape = preview->shape;
+        auto from   = to_local(grab_point);
+        to = to_local(to);
 
-        bool damage_last_bbox = should_damage_last();
-        overlay_clear(shape_overlay);
-
-        cairo_init(ol);
-        cairo_t *cr = ol->cr;
-
-        auto radius =
-            glm::distance(glm::vec2(from.x, from.y), glm::vec2(to.x, to.y));
+        shape.clear();
+        shape.begin_stroke(draw_method, line_width, stroke_color);
+        if ((draw_method == ANNOTATE_METHOD_RECTANGLE) && shapes_from_center)
+        {
+            double w = fabs(from.x - to.x);
+            double h = fabs(from.y - to.y);
+            shape.add_point({from.x - w, from.y - h});
+            shape.add_point({from.x + w, from.y + h});
+            return;
+        }
 
-        if (!shapes_from_center)
+        if ((draw_method == ANNOTATE_METHOD_CIRCLE) && !shapes_from_center)
         {
-            radius /= 2;
             from.x += (to.x - from.x) / 2;
             from.y += (to.y - from.y) / 2;
         }
 
-        cairo_set_line_width(cr, line_width);
-        cairo_set_source_rgba(cr,
-            wf::color_t(stroke_color).r,
-            wf::color_t(stroke_color).g,
-            wf::color_t(stroke_color).b,
-            wf::color_t(stroke_color).a);
-        cairo_arc(cr, from.x, from.y, radius, 0, 2 * M_PI);
-        cairo_stroke(cr);
+        shape.add_point(from);
+        shape.add_point(to);
+    }
 
-        wf::geometry_t bbox;
-        int padding = line_width + 1;
-        bbox.x     = (from.x - radius) - padding;
-        bbox.y     = (from.y - radius) - padding;
-        bbox.width = (radius * 2) + padding * 2;
-        bbox.height = (radius * 2) + padding * 2;
+    /* Damages a shape drawn in bbox, along with the previous shape preview
+     * in last_bbox */
+    void shape_drawn(wf::geometry_t bbox, bool damage_last_bbox)
+    {
         output->render->damage(bbox);
-        wf::regionf_t damage_region{bbox};
         if (damage_last_bbox)
         {
             output->render->damage(last_bbox);
-            damage_region |= last_bbox;
         }
 
-        damage_region &= output->get_relative_geometry();
-        auto damage_extents = damage_region.get_extents();
-        auto damage_box     = wf::to_integer_box(wf::geometry_t
-        {damage_extents.x1, damage_extents.y1, damage_extents.x2 - damage_extents.x1,
-            damage_extents.y2 - damage_extents.y1});
-        cairo_surface_upload_to_texture_with_damage(ol->cairo_surface, *ol->texture,
-            damage_box);
-
         get_node_overlay()->do_push_damage(wf::regionf_t(last_bbox));
         get_node_overlay()->do_push_damage(wf::regionf_t(bbox));
         last_bbox = bbox;
     }
 
-    wf::effect_hook_t frame_pre_paint = [=] ()
+    void draw_shape_preview(wf::pointf_t to)
     {
-        auto current_cursor = wf::get_core().get_cursor_position();
-        auto shape_overlay  = get_shape_overlay();
-        auto ol = get_current_overlay();
-
-        switch (draw_method)
-        {
-          case ANNOTATE_METHOD_DRAW:
-            cairo_draw(ol, last_cursor, current_cursor);
-            break;
-
-          case ANNOTATE_METHOD_LINE:
-            cairo_draw_line(shape_overlay, current_cursor);
-            break;
+        bool damage_last_bbox = (preview->node != nullptr);
 
-          case ANNOTATE_METHOD_RECTANGLE:
-            cairo_draw_rectangle(shape_overlay, current_cursor);
-            break;
-
-          case ANNOTATE_METHOD_CIRCLE:
-            cairo_draw_circle(shape_overlay, current_cursor);
-            break;
+        set_shape(to);
+        preview->node = get_node_overlay().get();
+        shape_drawn(preview->get_bbox(), damage_last_bbox);
+    }
 
-          default:
-            return;
+    wf::effect_hook_t frame_pre_paint = [=] ()
+    {
+        if (freehand)
+        {
+            draw_freehand(false);
+        } else
+        {
+            draw_shape_preview(wf::get_core().get_cursor_position());
         }
-
-        last_cursor = current_cursor;
     };
 
     void grab()
@@ -770,23 +2950,120 @@ class wayfire_annotate_screen : public wf::per_output_plugin_instance_t, public
     void fini() override
     {
         ungrab();
+        on_tablet_axis.disconnect();
         output->rem_binding(&draw_begin);
         output->rem_binding(&clear_workspace);
+        output->rem_binding(&undo_cb);
+        output->rem_binding(&redo_cb);
         for (auto& row : overlays)
         {
             for (auto& overlay : row)
             {
-                overlay_destroy(overlay->overlay);
-                overlay_destroy(overlay->shape_overlay);
+                overlay->overlay->clear();
                 wf::scene::remove_child(overlay);
             }
         }
 
+        if (rasterizer)
+        {
+            rasterizer->on_updates = nullptr;
+        }
+
+        if (preview)
+        {
+            wf::gles::run_in_context([&]
+            {
+                preview->program.free_resources();
+            });
+        }
+
         output->render->damage_whole();
     }
 };
 
-DECLARE_WAYFIRE_PLUGIN(wf::per_output_plugin_t<wayfire_annotate_screen>);
+class wayfire_annotate_global : public wf::plugin_interface_t,
+    public wf::per_output_tracker_mixin_t<wayfire_annotate_screen>
+{
+    wf::shared_data::ref_ptr_t<wf::ipc::method_repository_t> ipc_repo;
+
+  public:
+    void init() override
+    {
+        this->init_output_tracking();
+        ipc_repo->register_method("annotate/undo", on_ipc_undo);
+        ipc_repo->register_method("annotate/redo", on_ipc_redo);
+        ipc_repo->register_method("annotate/draw", on_ipc_draw);
+        ipc_repo->register_method("annotate/clear", on_ipc_clear);
+    }
+
+    wayfire_annotate_screen *find_instance(wf::json_t data)
+    {
+        auto output_id = wf::ipc::json_get_optional_uint64(data, "output-id");
+        wf::output_t *output = output_id.has_value() ?
+            wf::ipc::find_output_by_id(output_id.value()) : wf::get_core().seat->get_active_output();
+        if (!output || !output_instance.count(output))
+        {
+            return nullptr;
+        }
+
+        return output_instance[output].get();
+    }
+
+    wf::ipc::method_callback on_ipc_undo = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto instance = find_instance(data);
+        if (!instance)
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        return instance->undo() ? wf::ipc::json_ok() : wf::ipc::json_error("Nothing to undo.");
+    };
+
+    wf::ipc::method_callback on_ipc_redo = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto instance = find_instance(data);
+        if (!instance)
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        return instance->redo() ? wf::ipc::json_ok() : wf::ipc::json_error("Nothing to redo.");
+    };
+
+    wf::ipc::method_callback on_ipc_draw = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto instance = find_instance(data);
+        if (!instance)
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        return instance->ipc_draw(data);
+    };
+
+    wf::ipc::method_callback on_ipc_clear = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto instance = find_instance(data);
+        if (!instance)
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        return instance->ipc_clear(data);
+    };
+
+    void fini() override
+    {
+        ipc_repo->unregister_method("annotate/undo");
+        ipc_repo->unregister_method("annotate/redo");
+        ipc_repo->unregister_method("annotate/draw");
+        ipc_repo->unregister_method("annotate/clear");
+        this->fini_output_tracking();
+    }
+};
+
+DECLARE_WAYFIRE_PLUGIN(wayfire_annotate_global);
 }
 }
 }
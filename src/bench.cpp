@@ -23,15 +23,34 @@
  */
 
 #include <math.h>
-#include <deque>
-#include <numeric>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <wayfire/core.hpp>
 #include <wayfire/plugin.hpp>
 #include <wayfire/output.hpp>
+#include <wayfire/opengl.hpp>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
 #include <wayfire/workarea.hpp>
+#include <wayfire/seat.hpp>
+#include <wayfire/output-layout.hpp>
 #include <wayfire/render-manager.hpp>
+#include <wayfire/bindings-repository.hpp>
 #include <wayfire/per-output-plugin.hpp>
 #include <wayfire/plugins/common/cairo-util.hpp>
+#include <wayfire/plugins/common/shared-core-data.hpp>
+#include <wayfire/plugins/ipc/ipc-helpers.hpp>
+#include <wayfire/plugins/ipc/ipc-method-repository.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/util/log.hpp>
 #include <wayfire/util.hpp>
 
 extern "C"
@@ -40,49 +59,1489 @@ extern "C"
 }
 
 #define WIDGET_PADDING 10
+/* Frames further apart than this are considered idle time, not frame time. */
+#define IDLE_TIMEOUT_MS 1000
+/* Input events which can wait for a present at the same time, per output */
+#define INPUT_RING_SIZE 64
+#define NUM_STATS_LINES 9
+
+static int64_t timespec_to_us(const timespec& ts)
+{
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t get_time_us()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_us(ts);
+}
+
+/*
+ * Log-linear frame time histogram, in the spirit of HdrHistogram. Values are
+ * in microseconds. Every power of two range above SUB_BUCKETS is split into
+ * SUB_BUCKETS / 2 linear buckets, so any value is reported with less than
+ * 2 / SUB_BUCKETS relative error. Only the last N samples are counted, the
+ * older ones are taken out of the histogram again as new samples arrive.
+ * Memory is allocated once in resize(), recording a sample never allocates.
+ */
+class frame_time_histogram_t
+{
+  public:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr int SUB_BUCKETS     = 1 << SUB_BUCKET_BITS;
+    /* Values above 2^27 us (more than two minutes) are clamped. */
+    static constexpr int MAX_VALUE_BITS = 27;
+    static constexpr int NUM_BUCKETS    =
+        (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+    static constexpr uint32_t MAX_VALUE = (1u << MAX_VALUE_BITS) - 1;
+
+    void resize(int window)
+    {
+        samples.assign(std::max(window, 1), 0);
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(std::begin(counts), std::end(counts), 0);
+        head = 0;
+        total     = 0;
+        max_value = 0;
+        max_dirty = false;
+    }
+
+    void record(uint32_t value)
+    {
+        value = std::min(value, MAX_VALUE);
+        if (total == samples.size())
+        {
+            uint32_t old = samples[head];
+            counts[bucket_index(old)]--;
+            total--;
+            if (old >= max_value)
+            {
+                max_dirty = true;
+            }
+        }
+
+        samples[head] = value;
+        head = (head + 1) % samples.size();
+        counts[bucket_index(value)]++;
+        total++;
+
+        if (value >= max_value)
+        {
+            max_value = value;
+            max_dirty = false;
+        }
+    }
+
+    uint32_t size() const
+    {
+        return total;
+    }
+
+    /* Mean of the last n recorded samples. */
+    double recent_mean(uint32_t n) const
+    {
+        n = std::min(n, total);
+        if (n == 0)
+        {
+            return 0.0;
+        }
+
+        uint64_t sum = 0;
+        for (uint32_t i = 1; i <= n; i++)
+        {
+            sum += samples[(head + samples.size() - i) % samples.size()];
+        }
+
+        return double(sum) / n;
+    }
+
+    uint32_t get_max()
+    {
+        if (max_dirty)
+        {
+            max_value = 0;
+            for (uint32_t i = 1; i <= total; i++)
+            {
+                max_value = std::max(max_value, samples[(head + samples.size() - i) % samples.size()]);
+            }
+
+            max_dirty = false;
+        }
+
+        return max_value;
+    }
+
+    /* Returns the highest value equivalent to the given percentile. */
+    uint32_t get_percentile(double percentile)
+    {
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        uint64_t target = std::max<uint64_t>(1, ceil(percentile / 100.0 * total));
+        uint64_t seen   = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen >= target)
+            {
+                return std::min(bucket_upper_bound(i), get_max());
+            }
+        }
+
+        return get_max();
+    }
+
+    const uint32_t *get_counts() const
+    {
+        return counts;
+    }
+
+    static int bucket_index(uint32_t value)
+    {
+        int msb   = 31 - __builtin_clz(value | 1);
+        int shift = std::max(0, msb - (SUB_BUCKET_BITS - 1));
+        return shift * (SUB_BUCKETS / 2) + (value >> shift);
+    }
+
+    static uint32_t bucket_lower_bound(int index)
+    {
+        int shift = std::max(0, index / (SUB_BUCKETS / 2) - 1);
+        return uint32_t(index - shift * (SUB_BUCKETS / 2)) << shift;
+    }
+
+    static uint32_t bucket_upper_bound(int index)
+    {
+        int shift = std::max(0, index / (SUB_BUCKETS / 2) - 1);
+        return bucket_lower_bound(index) + (1u << shift) - 1;
+    }
+
+  private:
+    uint32_t counts[NUM_BUCKETS];
+    std::vector<uint32_t> samples;
+    uint32_t head  = 0;
+    uint32_t total = 0;
+    uint32_t max_value = 0;
+    bool max_dirty     = false;
+};
+
+/*
+ * Frame trace recorder writing Chrome trace-event JSON into a memory-mapped
+ * ring file of fixed size. The file starts with a header holding the opening
+ * bracket and the thread name metadata, followed by fixed-size slots holding
+ * one event each. Unused bytes are spaces and the closing bracket is omitted,
+ * which trace viewers accept, so the file on disk is a loadable trace at any
+ * time, even after a crash. When the ring is full, the oldest events are
+ * overwritten.
+ */
+class bench_trace_t
+{
+    static constexpr size_t HEADER_SIZE = 4096;
+    static constexpr size_t SLOT_SIZE   = 128;
+
+    int fd    = -1;
+    char *map = nullptr;
+    size_t map_size  = 0;
+    size_t num_slots = 0;
+    size_t next_slot = 0;
+    bool wrapped     = false;
+    std::string metadata;
+
+    char *get_slot(size_t index)
+    {
+        return map + HEADER_SIZE + index * SLOT_SIZE;
+    }
+
+    void write_slot(const char *event, int len)
+    {
+        char *slot = get_slot(next_slot);
+        len = std::clamp(len, 0, int(SLOT_SIZE) - 1);
+        memcpy(slot, event, len);
+        memset(slot + len, ' ', SLOT_SIZE - 1 - len);
+
+        next_slot = (next_slot + 1) % num_slots;
+        wrapped  |= next_slot == 0;
+    }
+
+  public:
+    bool is_recording()
+    {
+        return map != nullptr;
+    }
+
+    bool start(const std::string& path, size_t size)
+    {
+        stop();
+
+        num_slots = std::max<size_t>(size > HEADER_SIZE ? (size - HEADER_SIZE) / SLOT_SIZE : 0, 64);
+        map_size  = HEADER_SIZE + num_slots * SLOT_SIZE;
+
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            LOGE("bench: failed to open trace file ", path, ": ", strerror(errno));
+            return false;
+        }
+
+        if (ftruncate(fd, map_size) < 0)
+        {
+            LOGE("bench: failed to resize trace file ", path, ": ", strerror(errno));
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        void *ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            LOGE("bench: failed to map trace file ", path, ": ", strerror(errno));
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        map = static_cast<char*>(ptr);
+        memset(map, ' ', map_size);
+        for (size_t i = 0; i < num_slots; i++)
+        {
+            get_slot(i)[SLOT_SIZE - 1] = '\n';
+        }
+
+        next_slot = 0;
+        wrapped   = false;
+        set_threads({});
+
+        return true;
+    }
+
+    void stop()
+    {
+        if (!map)
+        {
+            return;
+        }
+
+        msync(map, map_size, MS_ASYNC);
+        munmap(map, map_size);
+        close(fd);
+        map = nullptr;
+        fd  = -1;
+    }
+
+    /* Name the trace threads, one per output. */
+    void set_threads(const std::vector<std::pair<uint32_t, std::string>>& threads)
+    {
+        metadata = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"args\":{\"name\":\"wayfire\"}},\n";
+        for (auto& [tid, name] : threads)
+        {
+            std::string line = "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" +
+                std::to_string(tid) + ",\"args\":{\"name\":\"" + name + "\"}},\n";
+            if (metadata.size() + line.size() + 2 >= HEADER_SIZE)
+            {
+                break;
+            }
+
+            metadata += line;
+        }
+
+        if (!map)
+        {
+            return;
+        }
+
+        memset(map, ' ', HEADER_SIZE);
+        memcpy(map, "[\n", 2);
+        memcpy(map + 2, metadata.data(), metadata.size());
+        map[HEADER_SIZE - 1] = '\n';
+    }
+
+    void complete_event(const char *name, uint32_t tid, int64_t ts, int64_t dur)
+    {
+        char event[SLOT_SIZE];
+        int len = snprintf(event, sizeof(event),
+            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld},",
+            name, tid, (long long)ts, (long long)dur);
+        write_slot(event, len);
+    }
+
+    void instant_event(const char *name, uint32_t tid, int64_t ts)
+    {
+        char event[SLOT_SIZE];
+        int len = snprintf(event, sizeof(event),
+            "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%lld},",
+            name, tid, (long long)ts);
+        write_slot(event, len);
+    }
+
+    /*
+     * Write the events of the last given seconds (all events if zero) in
+     * chronological order to a standalone, properly terminated trace file.
+     */
+    bool dump(const std::string& path, int seconds)
+    {
+        if (!map)
+        {
+            return false;
+        }
+
+        int64_t since = seconds > 0 ? get_time_us() - int64_t(seconds) * 1000000 : 0;
+        std::string out = "[\n" + metadata;
+        size_t first    = wrapped ? next_slot : 0;
+        size_t count    = wrapped ? num_slots : next_slot;
+        for (size_t i = 0; i < count; i++)
+        {
+            const char *slot = get_slot((first + i) % num_slots);
+            const char *ts   = (const char*)memmem(slot, SLOT_SIZE, "\"ts\":", 5);
+            if (!ts || (atoll(ts + 5) < since))
+            {
+                continue;
+            }
+
+            size_t len = SLOT_SIZE - 1;
+            while (len > 0 && slot[len - 1] == ' ')
+            {
+                len--;
+            }
+
+            out.append(slot, len);
+            out += "\n";
+        }
+
+        /* Drop the trailing comma of the last event and close the array */
+        out.erase(out.find_last_of(','), 1);
+        out += "]\n";
+
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            LOGE("bench: failed to open trace dump file ", path, ": ", strerror(errno));
+            return false;
+        }
+
+        bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+        ok &= fclose(file) == 0;
+        return ok;
+    }
+};
+
+static const char *stats_labels[NUM_STATS_LINES] = {
+    "p50", "p90", "p99", "p99.9", "max", "in p50", "in p99", "cpu", "gpu"
+};
+
+static const char *widget_vertex_shader =
+    R"(
+#version 100
+
+attribute highp vec2 position;
+attribute highp vec2 texcoord;
+
+varying highp vec2 uvpos;
+varying highp vec2 pos;
+
+uniform mat4 mvp;
+
+void main() {
+
+   gl_Position = mvp * vec4(position.xy, 0.0, 1.0);
+   uvpos = texcoord;
+   pos   = position;
+}
+)";
+
+static const char *widget_texture_fragment_shader =
+    R"(
+#version 100
+precision mediump float;
+
+uniform sampler2D tex;
+uniform vec4 color;
+
+varying highp vec2 uvpos;
+
+void main()
+{
+    gl_FragColor = texture2D(tex, uvpos) * color;
+}
+)";
+
+/* The filled part of the fps gauge. Angles follow cairo, which measures them
+ * clockwise with y pointing down, so the static gauge background drawn with
+ * cairo lines up with this. */
+static const char *widget_gauge_fragment_shader =
+    R"(
+#version 100
+precision highp float;
+
+uniform vec2 center;
+uniform float radius;
+uniform float fill;
+uniform vec4 color;
+
+varying highp vec2 pos;
+
+const float PI = 3.1415926535;
+
+void main()
+{
+    vec2 d = pos - center;
+    float angle = mod(atan(d.y, d.x) - 7.0 * PI / 8.0, 2.0 * PI);
+    float edge  = clamp(radius - length(d) + 0.5, 0.0, 1.0);
+    gl_FragColor = angle <= fill ? color * edge : vec4(0.0);
+}
+)";
+
+/* Two triangles of position.xy, texcoord.xy each */
+static void append_quad(std::vector<GLfloat>& vertices, float x1, float y1, float x2, float y2,
+    float u1, float v1, float u2, float v2)
+{
+    const GLfloat quad[] = {
+        x1, y1, u1, v1,
+        x2, y1, u2, v1,
+        x2, y2, u2, v2,
+        x1, y1, u1, v1,
+        x2, y2, u2, v2,
+        x1, y2, u1, v2,
+    };
+    vertices.insert(vertices.end(), std::begin(quad), std::end(quad));
+}
+
+/* Must be called with the GL context current */
+static void upload_cairo_surface(GLuint& tex, cairo_surface_t *surface)
+{
+    cairo_surface_flush(surface);
+    if (!tex)
+    {
+        GL_CALL(glGenTextures(1, &tex));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
+    }
+
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, cairo_image_surface_get_stride(surface) / 4));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+        cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface),
+        0, GL_RGBA, GL_UNSIGNED_BYTE, cairo_image_surface_get_data(surface)));
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+}
+
+/*
+ * The digits used by the widget, rasterized once per font size into a small
+ * texture. Numbers are then drawn as one quad per glyph, so changing a value
+ * never involves cairo or a texture upload.
+ */
+class glyph_atlas_t
+{
+  public:
+    enum font_index
+    {
+        FONT_LARGE = 0,
+        FONT_SMALL = 1,
+        NUM_FONTS  = 2,
+    };
+
+  private:
+    static constexpr const char *GLYPHS = "0123456789.-";
+    static constexpr int NUM_GLYPHS     = 12;
+    static constexpr int GLYPH_PADDING  = 1;
+
+    struct font_t
+    {
+        double y, ascent, height;
+        double x[NUM_GLYPHS];
+        double width[NUM_GLYPHS];
+        double advance[NUM_GLYPHS];
+    };
+
+    font_t fonts[NUM_FONTS];
+    cairo_surface_t *surface = nullptr;
+    GLuint tex = 0;
+    bool dirty = false;
+
+    static int glyph_index(char c)
+    {
+        if ((c >= '0') && (c <= '9'))
+        {
+            return c - '0';
+        }
+
+        switch (c)
+        {
+          case '.':
+            return 10;
+
+          case '-':
+            return 11;
+
+          default:
+            return -1;
+        }
+    }
+
+  public:
+    ~glyph_atlas_t()
+    {
+        if (surface)
+        {
+            cairo_surface_destroy(surface);
+        }
+    }
+
+    void build(const double sizes[NUM_FONTS])
+    {
+        if (surface)
+        {
+            cairo_surface_destroy(surface);
+        }
+
+        /* Measure first to find the size of the atlas */
+        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+        cairo_t *cr = cairo_create(surface);
+        cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
+            CAIRO_FONT_WEIGHT_BOLD);
+
+        double width = 0, height = 0;
+        char glyph[2] = {0, 0};
+        for (int f = 0; f < NUM_FONTS; f++)
+        {
+            cairo_font_extents_t font_extents;
+            cairo_set_font_size(cr, sizes[f]);
+            cairo_font_extents(cr, &font_extents);
+            fonts[f].y      = height;
+            fonts[f].ascent = font_extents.ascent;
+            fonts[f].height = ceil(font_extents.ascent + font_extents.descent) + GLYPH_PADDING * 2;
+
+            double x = 0;
+            for (int i = 0; i < NUM_GLYPHS; i++)
+            {
+                cairo_text_extents_t extents;
+                glyph[0] = GLYPHS[i];
+                cairo_text_extents(cr, glyph, &extents);
+                fonts[f].x[i]       = x;
+                fonts[f].advance[i] = extents.x_advance;
+                fonts[f].width[i]   = ceil(std::max(extents.x_advance,
+                    extents.x_bearing + extents.width)) + GLYPH_PADDING * 2;
+                x += fonts[f].width[i];
+            }
+
+            width   = std::max(width, x);
+            height += fonts[f].height;
+        }
+
+        cairo_destroy(cr);
+        cairo_surface_destroy(surface);
+
+        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+        cr = cairo_create(surface);
+        cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
+            CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_source_rgba(cr, 1, 1, 1, 1);
+        for (int f = 0; f < NUM_FONTS; f++)
+        {
+            cairo_set_font_size(cr, sizes[f]);
+            for (int i = 0; i < NUM_GLYPHS; i++)
+            {
+                glyph[0] = GLYPHS[i];
+                cairo_move_to(cr, fonts[f].x[i] + GLYPH_PADDING,
+                    fonts[f].y + GLYPH_PADDING + fonts[f].ascent);
+                cairo_show_text(cr, glyph);
+            }
+        }
+
+        cairo_destroy(cr);
+        dirty = true;
+    }
+
+    double text_width(int font, const char *text)
+    {
+        double width = 0;
+        for (; *text; text++)
+        {
+            int i = glyph_index(*text);
+            width += i < 0 ? 0 : fonts[font].advance[i];
+        }
+
+        return width;
+    }
+
+    void append_text(std::vector<GLfloat>& vertices, int font, const char *text,
+        double x, double baseline)
+    {
+        auto& f = fonts[font];
+        double atlas_width  = cairo_image_surface_get_width(surface);
+        double atlas_height = cairo_image_surface_get_height(surface);
+        double top = baseline - f.ascent - GLYPH_PADDING;
+        for (; *text; text++)
+        {
+            int i = glyph_index(*text);
+            if (i < 0)
+            {
+                continue;
+            }
+
+            append_quad(vertices, x - GLYPH_PADDING, top,
+                x - GLYPH_PADDING + f.width[i], top + f.height,
+                f.x[i] / atlas_width, f.y / atlas_height,
+                (f.x[i] + f.width[i]) / atlas_width, (f.y + f.height) / atlas_height);
+            x += f.advance[i];
+        }
+    }
+
+    /* Must be called with the GL context current */
+    GLuint get_texture()
+    {
+        if (dirty)
+        {
+            upload_cairo_surface(tex, surface);
+            dirty = false;
+        }
+
+        return tex;
+    }
+
+    /* Must be called with the GL context current */
+    void release()
+    {
+        if (tex)
+        {
+            GL_CALL(glDeleteTextures(1, &tex));
+            tex = 0;
+        }
+
+        dirty = surface != nullptr;
+    }
+};
+
+/*
+ * Scrolling frame-time graph. The texture is a ring of one pixel wide
+ * columns: each new frame overwrites the oldest column with a single column
+ * upload, and the graph is drawn as two quads split at the write position,
+ * so the texture coordinates wrap around instead of anything being shifted.
+ */
+class frame_time_graph_t
+{
+    GLuint tex  = 0;
+    int width   = 0;
+    int height  = 0;
+    int head    = 0;
+    bool resized = false;
+    uint32_t full_scale = 1;
+    uint32_t late_threshold = 1;
+    /* Frame times waiting to be uploaded, at most one per column */
+    std::vector<uint32_t> pending;
+    std::vector<uint8_t> column;
+
+    void fill_column(uint32_t frame_time)
+    {
+        /* Premultiplied RGBA */
+        static const uint8_t on_time[4] = {41, 163, 41, 204};
+        static const uint8_t late[4]    = {204, 41, 41, 204};
+        const uint8_t *color = frame_time > late_threshold ? late : on_time;
+        int bar = std::min<uint64_t>(height, (uint64_t)frame_time * height / full_scale);
+        bar = std::max(bar, 1);
+
+        std::fill(column.begin(), column.end(), 0);
+        for (int y = height - bar; y < height; y++)
+        {
+            std::copy(color, color + 4, column.begin() + y * 4);
+        }
+    }
+
+  public:
+    void resize(int new_width, int new_height)
+    {
+        width   = std::max(new_width, 1);
+        height  = std::max(new_height, 1);
+        head    = 0;
+        resized = true;
+        pending.clear();
+        column.resize(height * 4);
+    }
+
+    /* Frame times at the top of the graph and above which bars are red */
+    void set_scale(uint32_t full, uint32_t late)
+    {
+        full_scale     = std::max<uint32_t>(full, 1);
+        late_threshold = late;
+    }
+
+    void push(uint32_t frame_time)
+    {
+        if (pending.size() >= (size_t)width)
+        {
+            pending.erase(pending.begin());
+        }
+
+        pending.push_back(frame_time);
+    }
+
+    /* Must be called with the GL context current */
+    GLuint get_texture()
+    {
+        if (resized && tex)
+        {
+            GL_CALL(glDeleteTextures(1, &tex));
+            tex = 0;
+        }
+
+        if (!tex)
+        {
+            std::vector<uint8_t> empty(width * height * 4, 0);
+            GL_CALL(glGenTextures(1, &tex));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+            GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
+                0, GL_RGBA, GL_UNSIGNED_BYTE, empty.data()));
+            resized = false;
+        }
+
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+        for (auto frame_time : pending)
+        {
+            fill_column(frame_time);
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, head, 0, 1, height,
+                GL_RGBA, GL_UNSIGNED_BYTE, column.data()));
+            head = (head + 1) % width;
+        }
+
+        pending.clear();
+        return tex;
+    }
+
+    /* Oldest column on the left, newest on the right */
+    void append_quads(std::vector<GLfloat>& vertices, wf::geometry_t box)
+    {
+        float split = box.x + box.width * (float)(width - head) / width;
+        float u     = (float)head / width;
+        append_quad(vertices, box.x, box.y, split, box.y + box.height, u, 0, 1, 1);
+        if (head > 0)
+        {
+            append_quad(vertices, split, box.y, box.x + box.width, box.y + box.height, 0, 0, u, 1);
+        }
+    }
+
+    /* Must be called with the GL context current */
+    void release()
+    {
+        if (tex)
+        {
+            GL_CALL(glDeleteTextures(1, &tex));
+            tex = 0;
+        }
+    }
+};
+
+/*
+ * GPU render time from timer queries. A few queries are kept in flight and a
+ * result is only read once the GPU reports it available, so measuring never
+ * waits for the GPU. Frames which start while every query is still in flight
+ * are not measured.
+ */
+class gpu_timer_t
+{
+    static constexpr int NUM_QUERIES = 4;
+
+    PFNGLGENQUERIESEXTPROC gen_queries = nullptr;
+    PFNGLDELETEQUERIESEXTPROC delete_queries = nullptr;
+    PFNGLBEGINQUERYEXTPROC begin_query = nullptr;
+    PFNGLENDQUERYEXTPROC end_query = nullptr;
+    PFNGLGETQUERYOBJECTUIVEXTPROC get_query_uiv = nullptr;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64v = nullptr;
+    GLuint queries[NUM_QUERIES];
+    /* Queries started and queries read, the ring index is taken modulo */
+    uint32_t head  = 0;
+    uint32_t tail  = 0;
+    bool running   = false;
+    bool supported = false;
+    bool disjoint_ext = false;
+
+  public:
+    /* Must be called with the GL context current */
+    bool init()
+    {
+        auto ext = (const char*)glGetString(GL_EXTENSIONS);
+        std::string extensions = ext ? ext : "";
+        std::string suffix;
+        if (extensions.find("GL_EXT_disjoint_timer_query") != std::string::npos)
+        {
+            suffix = "EXT";
+            disjoint_ext = true;
+        } else if (extensions.find("GL_ARB_timer_query") == std::string::npos)
+        {
+            return false;
+        }
+
+        /* The ARB entry points have the same signatures, without the suffix */
+        auto load = [&] (std::string name)
+        {
+            return eglGetProcAddress((name + suffix).c_str());
+        };
+        gen_queries     = (PFNGLGENQUERIESEXTPROC)load("glGenQueries");
+        delete_queries  = (PFNGLDELETEQUERIESEXTPROC)load("glDeleteQueries");
+        begin_query     = (PFNGLBEGINQUERYEXTPROC)load("glBeginQuery");
+        end_query       = (PFNGLENDQUERYEXTPROC)load("glEndQuery");
+        get_query_uiv   = (PFNGLGETQUERYOBJECTUIVEXTPROC)load("glGetQueryObjectuiv");
+        get_query_ui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)load("glGetQueryObjectui64v");
+        if (!gen_queries || !delete_queries || !begin_query || !end_query ||
+            !get_query_uiv || !get_query_ui64v)
+        {
+            return false;
+        }
+
+        gen_queries(NUM_QUERIES, queries);
+        head = tail = 0;
+        supported   = true;
+        return true;
+    }
+
+    bool is_supported()
+    {
+        return supported;
+    }
+
+    /* Must be called with the GL context current */
+    void begin()
+    {
+        if (!supported || running || (head - tail == NUM_QUERIES))
+        {
+            return;
+        }
+
+        begin_query(GL_TIME_ELAPSED_EXT, queries[head % NUM_QUERIES]);
+        running = true;
+    }
+
+    /* Must be called with the GL context current */
+    void end()
+    {
+        if (!running)
+        {
+            return;
+        }
+
+        end_query(GL_TIME_ELAPSED_EXT);
+        running = false;
+        head++;
+    }
+
+    /* Record the results which are available, in microseconds.
+     * Must be called with the GL context current */
+    void collect(frame_time_histogram_t& times)
+    {
+        if (!supported)
+        {
+            return;
+        }
+
+        /* Results overlapping a disjoint event, e.g. a GPU frequency
+         * change, are meaningless and are dropped. */
+        GLint disjoint = 0;
+        if (disjoint_ext)
+        {
+            GL_CALL(glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint));
+        }
+
+        for (; tail != head; tail++)
+        {
+            GLuint available = 0;
+            get_query_uiv(queries[tail % NUM_QUERIES], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+            if (!available)
+            {
+                break;
+            }
+
+            GLuint64 elapsed = 0;
+            get_query_ui64v(queries[tail % NUM_QUERIES], GL_QUERY_RESULT_EXT, &elapsed);
+            if (!disjoint)
+            {
+                times.record(std::min<GLuint64>(elapsed / 1000, frame_time_histogram_t::MAX_VALUE));
+            }
+        }
+    }
+
+    /* Must be called with the GL context current */
+    void release()
+    {
+        if (!supported)
+        {
+            return;
+        }
+
+        end();
+        delete_queries(NUM_QUERIES, queries);
+        supported = false;
+    }
+};
 
 class wayfire_bench_screen : public wf::per_output_plugin_instance_t
 {
     cairo_t *cr = nullptr;
     double text_y;
-    double max_fps = 0;
+    double max_fps     = 0;
+    double current_fps = 0;
+    uint64_t frame_count    = 0;
+    uint64_t late_frames    = 0;
+    uint64_t dropped_frames = 0;
     double widget_xc;
-    uint32_t last_time = wf::get_current_time();
+    int64_t last_time = get_time_us();
+    int64_t last_present    = 0;
+    int64_t last_widget_update = 0;
+    bool widget_ready = false;
+    bool load_enabled = false;
+    uint64_t load_frame = 0;
+    int load_cursor     = 0;
+    std::minstd_rand load_rng;
+    std::string current_mode;
     double widget_radius;
+    double font_size;
+    double stats_x;
+    double stats_font_size;
+    double stats_line_height;
+    double stats_value_x;
     wf::wl_timer<false> timer;
+    wf::wl_listener_wrapper on_present;
+    wf::wl_listener_wrapper on_commit;
+    bench_trace_t *trace = nullptr;
+    int64_t frame_start  = 0;
+    frame_time_histogram_t cpu_render_times;
+    frame_time_histogram_t gpu_render_times;
+    gpu_timer_t gpu_timer;
     wf::owned_texture_t bench_tex;
+    /* With GLES, the widget is drawn from a static background, a glyph atlas,
+     * a shader for the gauge and the graph ring. Nothing is rasterized per
+     * frame. Other renderers redraw the whole widget with cairo instead. */
+    bool gles_widget = false;
+    bool background_dirty = false;
+    GLuint background_tex = 0;
+    OpenGL::program_t texture_program;
+    OpenGL::program_t gauge_program;
+    glyph_atlas_t glyphs;
+    frame_time_graph_t graph;
+    wf::geometry_t graph_box;
+    std::vector<GLfloat> vertices;
+    double fps_fill = 0;
+    char fps_text[32]  = "";
+    char stats_text[NUM_STATS_LINES][32] = {};
     wf::geometry_t cairo_geometry;
     cairo_surface_t *cairo_surface;
     cairo_text_extents_t text_extents;
-    std::deque<int> last_frame_times;
+    frame_time_histogram_t frame_times;
+    frame_time_histogram_t input_latency;
+    /* Timestamps of input events waiting for their frame to be presented.
+     * The counters only grow, indices into the ring are taken modulo its
+     * size. Events before input_committed are in the frame in flight. */
+    int64_t pending_inputs[INPUT_RING_SIZE];
+    uint32_t input_head = 0;
+    uint32_t input_tail = 0;
+    uint32_t input_committed = 0;
     wf::option_wrapper_t<std::string> position{"bench/position"};
     wf::option_wrapper_t<int> average_frames{"bench/average_frames"};
+    wf::option_wrapper_t<int> window_frames{"bench/window_frames"};
+    wf::option_wrapper_t<std::string> mode{"bench/mode"};
+    wf::option_wrapper_t<int> passive_update_interval{"bench/passive_update_interval"};
+    wf::option_wrapper_t<wf::activatorbinding_t> toggle_load_binding{"bench/toggle_load"};
+    wf::option_wrapper_t<std::string> load_pattern{"bench/load_pattern"};
+    wf::option_wrapper_t<int> load_rects{"bench/load_rects"};
+    wf::option_wrapper_t<int> load_rect_size{"bench/load_rect_size"};
+    wf::option_wrapper_t<bool> gpu_timing{"bench/gpu_timing"};
 
   public:
+    /* Called after every presented frame, used for IPC watchers. */
+    std::function<void()> frame_presented;
+
     void init() override
     {
-        output->render->add_effect(&damage_hook, wf::OUTPUT_EFFECT_DAMAGE);
-        output->render->add_effect(&overlay_hook, wf::OUTPUT_EFFECT_OVERLAY);
+        frame_times.resize(std::max<int>(window_frames, average_frames));
+        input_latency.resize(window_frames);
+        cpu_render_times.resize(window_frames);
+        gpu_render_times.resize(window_frames);
+
+        on_present.set_callback([=] (void *data)
+        {
+            handle_present(static_cast<wlr_output_event_present*>(data));
+        });
+        on_present.connect(&output->handle->events.present);
+        on_commit.set_callback([=] (void *data)
+        {
+            handle_commit(static_cast<wlr_output_event_commit*>(data));
+        });
+        on_commit.connect(&output->handle->events.commit);
 
         output->connect(&workarea_changed);
         position.set_callback(position_changed);
+        window_frames.set_callback(window_changed);
+        average_frames.set_callback(window_changed);
+        mode.set_callback(mode_changed);
+        output->add_activator(toggle_load_binding, &on_toggle_load);
+
+        gles_widget = wf::get_core().is_gles2();
+        if (gles_widget)
+        {
+            wf::gles::run_in_context([&]
+            {
+                texture_program.set_simple(OpenGL::compile_program(widget_vertex_shader,
+                    widget_texture_fragment_shader));
+                gauge_program.set_simple(OpenGL::compile_program(widget_vertex_shader,
+                    widget_gauge_fragment_shader));
+            });
+        }
+
         update_texture_position();
 
-        reset_timeout();
+        gpu_timing.set_callback(gpu_timing_changed);
+        set_gpu_timing(gpu_timing);
+        output->render->add_effect(&frame_start_hook, wf::OUTPUT_EFFECT_PRE);
+        output->render->add_effect(&render_done_hook, wf::OUTPUT_EFFECT_PASS_DONE);
+
+        set_mode(mode);
     }
 
-    void compute_timing()
+    /*
+     * Synthetic damage load. Every frame, damage rectangles are generated in
+     * the configured pattern and another frame is scheduled right away, so
+     * the render path runs continuously without any client. The random
+     * pattern is seeded the same way every time, so runs are reproducible.
+     */
+    void set_load(bool enabled)
     {
-        uint32_t current_time = wf::get_current_time();
-        uint32_t elapsed = current_time - last_time;
-        last_time = current_time;
-        while ((int)last_frame_times.size() >= average_frames)
+        if (load_enabled == enabled)
+        {
+            return;
+        }
+
+        load_enabled = enabled;
+        if (enabled)
+        {
+            load_frame  = 0;
+            load_cursor = 0;
+            load_rng.seed(1);
+            output->render->add_effect(&load_hook, wf::OUTPUT_EFFECT_DAMAGE);
+            output->render->schedule_redraw();
+        } else
+        {
+            output->render->rem_effect(&load_hook);
+        }
+    }
+
+    wf::activator_callback on_toggle_load = [=] (auto)
+    {
+        set_load(!load_enabled);
+        return true;
+    };
+
+    void generate_load()
+    {
+        auto og   = output->get_relative_geometry();
+        int size  = std::clamp<int>(load_rect_size, 1, std::max(1, std::min(og.width, og.height)));
+        int count = std::max<int>(load_rects, 1);
+        std::string pattern = load_pattern;
+
+        if (pattern == "fullscreen")
+        {
+            output->render->damage(og, false);
+        } else if (pattern == "scroll")
+        {
+            /* A band of height size moving down, split into count columns */
+            int y = (load_frame * std::max(size / 4, 1)) % og.height;
+            int column_width = std::max(og.width / count, 1);
+            for (int x = 0; x < og.width; x += column_width)
+            {
+                output->render->damage(wf::geometry_t{x, y, column_width, size}, false);
+            }
+        } else if (pattern == "checkerboard")
+        {
+            /* Walk over the tiles of one checker color per frame, alternating
+             * the color every frame */
+            int columns = (og.width + size - 1) / size;
+            int rows    = (og.height + size - 1) / size;
+            int tiles   = columns * rows;
+            int color   = load_frame % 2;
+            int damaged = 0;
+            for (int i = 0; (i < tiles) && (damaged < count); i++)
+            {
+                int tile = (load_cursor + i) % tiles;
+                int tx   = tile % columns;
+                int ty   = tile / columns;
+                if ((tx + ty) % 2 != color)
+                {
+                    continue;
+                }
+
+                output->render->damage(wf::geometry_t{tx * size, ty * size, size, size}, false);
+                damaged++;
+            }
+
+            load_cursor = (load_cursor + count * 2) % tiles;
+        } else
+        {
+            for (int i = 0; i < count; i++)
+            {
+                int x = load_rng() % std::max(og.width - size + 1, 1);
+                int y = load_rng() % std::max(og.height - size + 1, 1);
+                output->render->damage(wf::geometry_t{x, y, size, size}, false);
+            }
+        }
+
+        load_frame++;
+    }
+
+    wf::effect_hook_t load_hook = [=] ()
+    {
+        generate_load();
+        output->render->schedule_redraw();
+    };
+
+    bool is_load_enabled()
+    {
+        return load_enabled;
+    }
+
+    /*
+     * active:   damage the widget every frame and time the repaint loop. The
+     *           output never goes idle while bench is loaded.
+     * passive:  time real frames from present events and only refresh the
+     *           widget on frames which are repainted anyway, at a capped rate.
+     * headless: time real frames from present events and draw nothing.
+     */
+    void set_mode(std::string new_mode)
+    {
+        if ((new_mode != "passive") && (new_mode != "headless"))
+        {
+            new_mode = "active";
+        }
+
+        if (new_mode == current_mode)
+        {
+            return;
+        }
+
+        timer.disconnect();
+        output->render->rem_effect(&damage_hook);
+        output->render->rem_effect(&overlay_hook);
+
+        current_mode = new_mode;
+        last_present = 0;
+        last_time    = get_time_us();
+        frame_times.reset();
+        input_latency.reset();
+        cpu_render_times.reset();
+        gpu_render_times.reset();
+        input_committed = input_tail = input_head;
+        widget_ready    = false;
+        max_fps         = 0;
+        current_fps     = 0;
+        frame_count     = 0;
+        late_frames     = 0;
+        dropped_frames  = 0;
+
+        if (current_mode != "headless")
+        {
+            output->render->add_effect(&damage_hook, wf::OUTPUT_EFFECT_DAMAGE);
+            output->render->add_effect(&overlay_hook, wf::OUTPUT_EFFECT_OVERLAY);
+        }
+
+        if (current_mode == "active")
+        {
+            reset_timeout();
+        }
+
+        output->render->damage(cairo_geometry);
+    }
+
+    wf::config::option_base_t::updated_callback_t mode_changed = [=] ()
+    {
+        set_mode(mode);
+    };
+
+    void handle_present(wlr_output_event_present *ev)
+    {
+        if (!ev->presented)
+        {
+            return;
+        }
+
+        int64_t when = timespec_to_us(ev->when);
+        int64_t elapsed = when - last_present;
+        frame_count++;
+        if (last_present && (elapsed < IDLE_TIMEOUT_MS * 1000))
+        {
+            count_late_frames(elapsed);
+            if (current_mode != "active")
+            {
+                record_frame_time(elapsed);
+            }
+        }
+
+        last_present = when;
+        match_inputs(when);
+
+        if (trace)
+        {
+            trace->instant_event("present", output->get_id(), when);
+        }
+
+        if (frame_presented)
+        {
+            frame_presented();
+        }
+    }
+
+    void handle_commit(wlr_output_event_commit *ev)
+    {
+        if (!(ev->state->committed & WLR_OUTPUT_STATE_BUFFER))
+        {
+            return;
+        }
+
+        /* Input is processed on the same thread as rendering, so every input
+         * event received so far is contained in the committed frame. */
+        input_committed = input_head;
+
+        if (trace)
+        {
+            trace->instant_event("commit", output->get_id(), get_time_us());
+        }
+    }
+
+    /*
+     * Input-to-present latency. Input events are queued in a small ring, the
+     * next buffer commit marks all of them as part of that frame, and its
+     * present event takes them out of the ring again. Each event is touched
+     * a constant number of times. Input which does not change anything on
+     * screen is matched with whatever frame comes next, so events older than
+     * the idle timeout are dropped instead of being recorded.
+     */
+    void record_input()
+    {
+        if (input_head - input_tail == INPUT_RING_SIZE)
+        {
+            input_tail++;
+            input_committed = std::max(input_committed, input_tail);
+        }
+
+        pending_inputs[input_head % INPUT_RING_SIZE] = get_time_us();
+        input_head++;
+    }
+
+    void match_inputs(int64_t when)
+    {
+        for (; input_tail != input_committed; input_tail++)
+        {
+            int64_t latency = when - pending_inputs[input_tail % INPUT_RING_SIZE];
+            if ((latency >= 0) && (latency < IDLE_TIMEOUT_MS * 1000))
+            {
+                input_latency.record(latency);
+            }
+        }
+    }
+
+    /* Attaches the trace ring which this output's frame events are recorded
+     * into, or detaches it with nullptr. */
+    void set_trace(bench_trace_t *new_trace)
+    {
+        if (trace == new_trace)
+        {
+            return;
+        }
+
+        trace = new_trace;
+    }
+
+    /*
+     * CPU time of the render pass, from the start of the frame until the
+     * pass is done. With timer queries, the GPU time of the same span too.
+     */
+    wf::effect_hook_t frame_start_hook = [=] ()
+    {
+        frame_start = get_time_us();
+        if (gpu_timer.is_supported())
+        {
+            wf::gles::run_in_context([&]
+            {
+                gpu_timer.begin();
+            });
+        }
+    };
+
+    wf::effect_hook_t render_done_hook = [=] ()
+    {
+        if (!frame_start)
+        {
+            return;
+        }
+
+        int64_t elapsed = get_time_us() - frame_start;
+        cpu_render_times.record(std::min<int64_t>(elapsed, frame_time_histogram_t::MAX_VALUE));
+        if (trace)
+        {
+            trace->complete_event("render", output->get_id(), frame_start, elapsed);
+        }
+
+        if (gpu_timer.is_supported())
+        {
+            wf::gles::run_in_context([&]
+            {
+                gpu_timer.end();
+                gpu_timer.collect(gpu_render_times);
+            });
+        }
+
+        frame_start = 0;
+    };
+
+    /* Falls back to CPU timing only if timer queries are not available */
+    void set_gpu_timing(bool enabled)
+    {
+        if (!wf::get_core().is_gles2() || (enabled == gpu_timer.is_supported()))
+        {
+            return;
+        }
+
+        wf::gles::run_in_context([&]
+        {
+            if (!enabled)
+            {
+                gpu_timer.release();
+            } else if (!gpu_timer.init())
+            {
+                LOGI("bench: GPU timer queries are not supported, measuring CPU time only");
+            }
+        });
+        gpu_render_times.reset();
+    }
+
+    wf::config::option_base_t::updated_callback_t gpu_timing_changed = [=] ()
+    {
+        set_gpu_timing(gpu_timing);
+    };
+
+    int64_t get_refresh_period_us()
+    {
+        if (!output->handle->current_mode || (output->handle->current_mode->refresh <= 0))
+        {
+            return 0;
+        }
+
+        return 1000000000ll / output->handle->current_mode->refresh;
+    }
+
+    /* A frame is late if it took more than one and a half refresh periods,
+     * every refresh period it missed counts as a dropped frame. */
+    void count_late_frames(int64_t elapsed)
+    {
+        int64_t period = get_refresh_period_us();
+        if (!period || (elapsed * 2 <= period * 3))
+        {
+            return;
+        }
+
+        late_frames++;
+        dropped_frames += (elapsed + period / 2) / period - 1;
+    }
+
+    uint64_t get_frame_count()
+    {
+        return frame_count;
+    }
+
+    void record_frame_time(int64_t frame_time)
+    {
+        frame_time = std::min<int64_t>(frame_time, frame_time_histogram_t::MAX_VALUE);
+        frame_times.record(frame_time);
+        if (gles_widget)
+        {
+            graph.push(frame_time);
+        }
+
+        update_fps();
+    }
+
+    void update_fps()
+    {
+        double average = frame_times.recent_mean(average_frames);
+        current_fps = average > 0 ? 1000000 / average : 0;
+        max_fps     = std::max(max_fps, current_fps);
+    }
+
+    static wf::json_t percentiles_to_json(frame_time_histogram_t& histogram)
+    {
+        wf::json_t result;
+        result["samples"] = histogram.size();
+        result["mean"]    = histogram.recent_mean(histogram.size());
+        result["p50"]     = histogram.get_percentile(50.0);
+        result["p90"]     = histogram.get_percentile(90.0);
+        result["p99"]     = histogram.get_percentile(99.0);
+        result["p99.9"]   = histogram.get_percentile(99.9);
+        result["max"]     = histogram.get_max();
+        return result;
+    }
+
+    wf::json_t get_stats(bool with_histogram)
+    {
+        wf::json_t stats;
+        stats["output-id"]   = (uint64_t)output->get_id();
+        stats["output-name"] = output->to_string();
+        stats["mode"] = current_mode;
+        stats["load"] = load_enabled;
+        stats["refresh-mhz"]    = output->handle->current_mode ? output->handle->current_mode->refresh : 0;
+        stats["frames"]         = frame_count;
+        stats["late-frames"]    = late_frames;
+        stats["dropped-frames"] = dropped_frames;
+        stats["fps"]     = current_fps;
+        stats["max-fps"] = max_fps;
+
+        stats["frame-time-us"]    = percentiles_to_json(frame_times);
+        stats["input-latency-us"] = percentiles_to_json(input_latency);
+        stats["cpu-render-us"]    = percentiles_to_json(cpu_render_times);
+        stats["gpu-render-us"]    = percentiles_to_json(gpu_render_times);
+        stats["gpu-timer"] = gpu_timer.is_supported();
+
+        if (with_histogram)
         {
-            last_frame_times.pop_front();
+            /* Only non-empty buckets, as [lowest, highest] microseconds */
+            wf::json_t buckets = wf::json_t::array();
+            auto counts = frame_times.get_counts();
+            for (int i = 0; i < frame_time_histogram_t::NUM_BUCKETS; i++)
+            {
+                if (!counts[i])
+                {
+                    continue;
+                }
+
+                wf::json_t bucket;
+                bucket["from"]  = frame_time_histogram_t::bucket_lower_bound(i);
+                bucket["to"]    = frame_time_histogram_t::bucket_upper_bound(i);
+                bucket["count"] = counts[i];
+                buckets.append(bucket);
+            }
+
+            stats["histogram"] = buckets;
         }
 
-        last_frame_times.push_back(elapsed);
+        return stats;
+    }
+
+    void compute_timing()
+    {
+        int64_t current_time = get_time_us();
+        int64_t elapsed = current_time - last_time;
+        last_time = current_time;
 
+        record_frame_time(elapsed);
         reset_timeout();
 
         render_bench();
@@ -91,7 +1550,7 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
     void reset_timeout()
     {
         timer.disconnect();
-        timer.set_timeout(1000, [=] ()
+        timer.set_timeout(IDLE_TIMEOUT_MS, [=] ()
         {
             output->render->damage(cairo_geometry);
         });
@@ -102,10 +1561,20 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
         update_texture_position();
     };
 
+    wf::config::option_base_t::updated_callback_t window_changed = [=] ()
+    {
+        frame_times.resize(std::max<int>(window_frames, average_frames));
+        input_latency.resize(window_frames);
+        cpu_render_times.resize(window_frames);
+        gpu_render_times.resize(window_frames);
+        input_committed = input_tail = input_head;
+    };
+
     void cairo_recreate()
     {
         auto og = output->get_relative_geometry();
-        auto font_size = og.height * 0.05;
+        font_size = og.height * 0.05;
+        stats_font_size = font_size * 0.3;
 
         if (!cr)
         {
@@ -116,17 +1585,51 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
 
         cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
             CAIRO_FONT_WEIGHT_BOLD);
-        cairo_set_font_size(cr, font_size);
+        cairo_set_font_size(cr, stats_font_size);
+
+        /* Labels, right aligned values and the unit each get a column */
+        cairo_text_extents_t stats_extents;
+        double label_width = 0;
+        for (auto label : stats_labels)
+        {
+            cairo_text_extents(cr, label, &stats_extents);
+            label_width = std::max(label_width, stats_extents.x_advance);
+        }
+
+        cairo_text_extents(cr, " ", &stats_extents);
+        label_width += stats_extents.x_advance;
+        cairo_text_extents(cr, " ms", &stats_extents);
+        double unit_width = stats_extents.x_advance;
+        cairo_text_extents(cr, "1000.0", &stats_extents);
+        double value_width = stats_extents.x_advance;
+        stats_line_height  = stats_extents.height * 1.6;
+        stats_extents.width = label_width + value_width + unit_width;
 
+        cairo_set_font_size(cr, font_size);
         cairo_text_extents(cr, "1000.0", &text_extents);
 
         widget_xc = text_extents.width / 2 + text_extents.x_bearing + WIDGET_PADDING;
         text_y    = text_extents.height + WIDGET_PADDING;
         widget_radius = og.height * 0.04;
+        stats_x = text_extents.width + WIDGET_PADDING * 2;
+        stats_value_x = stats_x + label_width + value_width;
+
+        /* The percentile column sits to the right of the gauge */
+        cairo_geometry.width = text_extents.width + stats_extents.width +
+            WIDGET_PADDING * 3;
+        cairo_geometry.height = std::max(text_extents.height + widget_radius +
+            (widget_radius * sin(M_PI / 8)),
+            stats_line_height * NUM_STATS_LINES) + WIDGET_PADDING * 2;
 
-        cairo_geometry.width  = text_extents.width + WIDGET_PADDING * 2;
-        cairo_geometry.height = text_extents.height + widget_radius +
-            (widget_radius * sin(M_PI / 8)) + WIDGET_PADDING * 2;
+        if (gles_widget)
+        {
+            /* The frame-time graph runs along the bottom */
+            graph_box.x      = WIDGET_PADDING;
+            graph_box.y      = cairo_geometry.height;
+            graph_box.width  = cairo_geometry.width - WIDGET_PADDING * 2;
+            graph_box.height = stats_line_height * 3;
+            cairo_geometry.height += graph_box.height + WIDGET_PADDING;
+        }
 
         /* Recreate surface based on font size */
         cairo_destroy(cr);
@@ -139,6 +1642,83 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
         cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
             CAIRO_FONT_WEIGHT_BOLD);
         cairo_set_font_size(cr, font_size);
+
+        if (gles_widget)
+        {
+            const double sizes[glyph_atlas_t::NUM_FONTS] = {font_size, stats_font_size};
+            glyphs.build(sizes);
+
+            int64_t period = get_refresh_period_us();
+            if (!period)
+            {
+                period = 1000000 / 60;
+            }
+
+            graph.resize(graph_box.width, graph_box.height);
+            graph.set_scale(period * 2, period * 3 / 2);
+
+            render_background();
+        }
+    }
+
+    /* Everything in the GLES widget which only changes with its size */
+    void render_background()
+    {
+        double xc = widget_xc;
+        double yc = widget_radius + WIDGET_PADDING;
+
+        cairo_clear(cr);
+
+        cairo_set_line_width(cr, 5.0);
+        cairo_set_source_rgba(cr, 0, 0, 0, 1);
+        cairo_arc_negative(cr, xc, yc, widget_radius, M_PI / 8, M_PI - M_PI / 8);
+        cairo_stroke(cr);
+
+        cairo_set_source_rgba(cr, 0.7, 0.7, 0.7, 0.7);
+        cairo_move_to(cr, xc, yc);
+        cairo_arc_negative(cr, xc, yc, widget_radius, M_PI / 8, M_PI - M_PI / 8);
+        cairo_fill(cr);
+
+        set_text_source(cr);
+        cairo_set_font_size(cr, stats_font_size);
+        double y = WIDGET_PADDING;
+        for (auto label : stats_labels)
+        {
+            y += stats_line_height;
+            cairo_move_to(cr, stats_x, y);
+            cairo_show_text(cr, label);
+            cairo_move_to(cr, stats_value_x, y);
+            cairo_show_text(cr, " ms");
+        }
+
+        /* Graph background with a line at one refresh period */
+        cairo_set_source_rgba(cr, 0, 0, 0, 0.4);
+        cairo_rectangle(cr, graph_box.x, graph_box.y, graph_box.width, graph_box.height);
+        cairo_fill(cr);
+
+        cairo_set_line_width(cr, 1.0);
+        cairo_set_source_rgba(cr, 1, 1, 1, 0.5);
+        cairo_move_to(cr, graph_box.x, graph_box.y + graph_box.height / 2 + 0.5);
+        cairo_line_to(cr, graph_box.x + graph_box.width, graph_box.y + graph_box.height / 2 + 0.5);
+        cairo_stroke(cr);
+
+        background_dirty = true;
+    }
+
+    wf::color_t get_text_color()
+    {
+        if (output->handle->current_mode)
+        {
+            return {0, 0, 1, 1};
+        }
+
+        return {1, 1, 0, 1};
+    }
+
+    void set_text_source(cairo_t *cr)
+    {
+        auto color = get_text_color();
+        cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
     }
 
     void update_texture_position()
@@ -226,17 +1806,6 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
         double fps_angle;
         char fps_buf[128];
 
-        double average = std::accumulate(
-            last_frame_times.begin(), last_frame_times.end(), 0.0);
-        average /= last_frame_times.size();
-
-        double current_fps = 1000 / average;
-
-        if (current_fps > max_fps)
-        {
-            max_fps = current_fps;
-        }
-
         sprintf(fps_buf, "%.1f", current_fps);
 
         if (output->handle->current_mode)
@@ -250,6 +1819,23 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
                 (target_angle - max_angle);
         }
 
+        if (gles_widget)
+        {
+            /* Only the values change, they are drawn in the overlay hook */
+            fps_fill = std::clamp(fps_angle - max_angle, 0.0, target_angle - max_angle);
+            snprintf(fps_text, sizeof(fps_text), "%s", fps_buf);
+
+            double values[NUM_STATS_LINES];
+            get_stats_values(values);
+            for (int i = 0; i < NUM_STATS_LINES; i++)
+            {
+                format_stats_value(stats_text[i], sizeof(stats_text[i]), values[i]);
+            }
+
+            widget_ready = true;
+            return;
+        }
+
         cairo_clear(cr);
 
         cairo_set_line_width(cr, 5.0);
@@ -268,26 +1854,184 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
         cairo_arc_negative(cr, xc, yc, radius, fps_angle, max_angle);
         cairo_fill(cr);
 
-        if (output->handle->current_mode)
-        {
-            cairo_set_source_rgba(cr, 0, 0, 1, 1);
-        } else
-        {
-            cairo_set_source_rgba(cr, 1, 1, 0, 1);
-        }
-
+        set_text_source(cr);
+        cairo_set_font_size(cr, font_size);
         cairo_text_extents(cr, fps_buf, &text_extents);
         cairo_move_to(cr,
             xc - (text_extents.width / 2 + text_extents.x_bearing),
             text_y + yc);
         cairo_show_text(cr, fps_buf);
         cairo_stroke(cr);
-        bench_tex = wf::owned_texture_t{cairo_surface};
+
+        render_percentiles();
+
+        bench_tex    = wf::owned_texture_t{cairo_surface};
+        widget_ready = true;
+    }
+
+    /* In milliseconds, in the order of stats_labels */
+    void get_stats_values(double values[NUM_STATS_LINES])
+    {
+        values[0] = frame_times.get_percentile(50.0) / 1000.0;
+        values[1] = frame_times.get_percentile(90.0) / 1000.0;
+        values[2] = frame_times.get_percentile(99.0) / 1000.0;
+        values[3] = frame_times.get_percentile(99.9) / 1000.0;
+        values[4] = frame_times.get_max() / 1000.0;
+        values[5] = input_latency.get_percentile(50.0) / 1000.0;
+        values[6] = input_latency.get_percentile(99.0) / 1000.0;
+        values[7] = cpu_render_times.recent_mean(average_frames) / 1000.0;
+        values[8] = gpu_timer.is_supported() ?
+            gpu_render_times.recent_mean(average_frames) / 1000.0 : NAN;
+    }
+
+    /* Values which are not measured are shown as a dash */
+    static void format_stats_value(char *buf, size_t size, double value)
+    {
+        if (isnan(value))
+        {
+            snprintf(buf, size, "-");
+        } else
+        {
+            snprintf(buf, size, "%.1f", value);
+        }
+    }
+
+    void render_percentiles()
+    {
+        double values[NUM_STATS_LINES];
+        char value[32];
+        char buf[128];
+        double y = WIDGET_PADDING;
+
+        get_stats_values(values);
+        cairo_set_font_size(cr, stats_font_size);
+
+        for (int i = 0; i < NUM_STATS_LINES; i++)
+        {
+            y += stats_line_height;
+            format_stats_value(value, sizeof(value), values[i]);
+            sprintf(buf, "%s %s ms", stats_labels[i], value);
+            cairo_move_to(cr, stats_x, y);
+            cairo_show_text(cr, buf);
+        }
+    }
+
+    void draw_textured(GLuint tex, const glm::mat4& mvp, glm::vec4 color, int first, int count)
+    {
+        texture_program.use(wf::TEXTURE_TYPE_RGBA);
+        texture_program.uniformMatrix4f("mvp", mvp);
+        texture_program.uniform1i("tex", 0);
+        texture_program.uniform4f("color", color);
+        texture_program.attrib_pointer("position", 2, 4 * sizeof(GLfloat), vertices.data());
+        texture_program.attrib_pointer("texcoord", 2, 4 * sizeof(GLfloat), vertices.data() + 2);
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+        GL_CALL(glDrawArrays(GL_TRIANGLES, first, count));
+        texture_program.deactivate();
+    }
+
+    void render_gles_widget()
+    {
+        auto fb = output->render->get_target_framebuffer();
+        wf::regionf_t region;
+        region |= cairo_geometry;
+        region &= fb.geometry_region_from_framebuffer_region(output->render->get_swap_damage());
+        if (region.empty())
+        {
+            return;
+        }
+
+        float x  = cairo_geometry.x;
+        float y  = cairo_geometry.y;
+        float xc = x + widget_xc;
+        float yc = y + widget_radius + WIDGET_PADDING;
+        float r  = widget_radius + 1;
+
+        vertices.clear();
+        append_quad(vertices, x, y, x + cairo_geometry.width, y + cairo_geometry.height, 0, 0, 1, 1);
+        append_quad(vertices, xc - r, yc - r, xc + r, yc + r, 0, 0, 1, 1);
+        graph.append_quads(vertices, {(int)x + graph_box.x, (int)y + graph_box.y,
+            graph_box.width, graph_box.height});
+        int text_start = vertices.size() / 4;
+
+        double fps_width = glyphs.text_width(glyph_atlas_t::FONT_LARGE, fps_text);
+        glyphs.append_text(vertices, glyph_atlas_t::FONT_LARGE, fps_text,
+            xc - fps_width / 2, yc + text_y);
+
+        double line_y = y + WIDGET_PADDING;
+        for (auto& text : stats_text)
+        {
+            line_y += stats_line_height;
+            glyphs.append_text(vertices, glyph_atlas_t::FONT_SMALL, text,
+                x + stats_value_x - glyphs.text_width(glyph_atlas_t::FONT_SMALL, text), line_y);
+        }
+
+        int text_count = vertices.size() / 4 - text_start;
+        auto color     = get_text_color();
+
+        output->render->get_current_pass()->custom_gles_subpass(fb, [&]
+        {
+            if (background_dirty)
+            {
+                upload_cairo_surface(background_tex, cairo_surface);
+                background_dirty = false;
+            }
+
+            GLuint atlas_tex = glyphs.get_texture();
+            GLuint graph_tex = graph.get_texture();
+            auto mvp = wf::gles::render_target_orthographic_projection(fb);
+
+            wf::gles::bind_render_buffer(fb);
+            GL_CALL(glEnable(GL_BLEND));
+            GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+
+            for (const auto& box : region)
+            {
+                wf::gles::render_target_logic_scissor(fb, box);
+
+                draw_textured(background_tex, mvp, glm::vec4(1.0), 0, 6);
+
+                gauge_program.use(wf::TEXTURE_TYPE_RGBA);
+                gauge_program.uniformMatrix4f("mvp", mvp);
+                gauge_program.uniform2f("center", xc, yc);
+                gauge_program.uniform1f("radius", widget_radius);
+                gauge_program.uniform1f("fill", fps_fill);
+                gauge_program.uniform4f("color", glm::vec4(0.7, 0.14, 0.14, 0.7));
+                gauge_program.attrib_pointer("position", 2, 4 * sizeof(GLfloat), vertices.data());
+                gauge_program.attrib_pointer("texcoord", 2, 4 * sizeof(GLfloat), vertices.data() + 2);
+                GL_CALL(glDrawArrays(GL_TRIANGLES, 6, 6));
+                gauge_program.deactivate();
+
+                draw_textured(graph_tex, mvp, glm::vec4(1.0), 12, text_start - 12);
+                draw_textured(atlas_tex, mvp, glm::vec4(color.r, color.g, color.b, color.a),
+                    text_start, text_count);
+            }
+
+            GL_CALL(glDisable(GL_BLEND));
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        });
     }
 
     wf::effect_hook_t damage_hook = [=] ()
     {
-        if (!output->render->get_scheduled_damage().empty())
+        if (current_mode == "passive")
+        {
+            /* Piggyback on frames which are being repainted anyway, so
+             * that the widget itself never causes a frame. */
+            int64_t now = get_time_us();
+            if (output->render->get_scheduled_damage().empty() || (frame_times.size() == 0) ||
+                (now - last_widget_update < passive_update_interval * 1000))
+            {
+                return;
+            }
+
+            last_widget_update = now;
+            render_bench();
+            output->render->damage(cairo_geometry, false);
+            return;
+        }
+
+        if (load_enabled || !output->render->get_scheduled_damage().empty())
         {
             compute_timing();
         }
@@ -297,6 +2041,17 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
 
     wf::effect_hook_t overlay_hook = [=] ()
     {
+        if (!widget_ready)
+        {
+            return;
+        }
+
+        if (gles_widget)
+        {
+            render_gles_widget();
+            return;
+        }
+
         auto pass = output->render->get_current_pass();
         auto fb   = output->render->get_target_framebuffer();
         pass->add_texture(bench_tex.get_texture(), fb, cairo_geometry, cairo_geometry);
@@ -305,12 +2060,342 @@ class wayfire_bench_screen : public wf::per_output_plugin_instance_t
     void fini() override
     {
         timer.disconnect();
+        on_present.disconnect();
+        on_commit.disconnect();
+        set_trace(nullptr);
+        set_load(false);
+        set_gpu_timing(false);
+        output->render->rem_effect(&frame_start_hook);
+        output->render->rem_effect(&render_done_hook);
+        output->rem_binding(&on_toggle_load);
         output->render->rem_effect(&damage_hook);
         output->render->rem_effect(&overlay_hook);
         cairo_surface_destroy(cairo_surface);
         cairo_destroy(cr);
+        if (gles_widget)
+        {
+            wf::gles::run_in_context([&]
+            {
+                texture_program.free_resources();
+                gauge_program.free_resources();
+                glyphs.release();
+                graph.release();
+                if (background_tex)
+                {
+                    GL_CALL(glDeleteTextures(1, &background_tex));
+                }
+            });
+        }
+
         output->render->damage(cairo_geometry);
     }
 };
 
-DECLARE_WAYFIRE_PLUGIN(wf::per_output_plugin_t<wayfire_bench_screen>);
+class wayfire_bench : public wf::plugin_interface_t,
+    public wf::per_output_tracker_mixin_t<wayfire_bench_screen>
+{
+    wf::shared_data::ref_ptr_t<wf::ipc::method_repository_t> ipc_repo;
+    /* IPC clients watching the stats, with their update interval in frames */
+    std::map<wf::ipc::client_interface_t*, uint64_t> watchers;
+    bench_trace_t trace;
+    wf::option_wrapper_t<std::string> trace_file{"bench/trace_file"};
+    wf::option_wrapper_t<std::string> trace_dump_file{"bench/trace_dump_file"};
+    wf::option_wrapper_t<int> trace_buffer_size{"bench/trace_buffer_size"};
+    wf::option_wrapper_t<wf::activatorbinding_t> toggle_trace_binding{"bench/toggle_trace"};
+    wf::option_wrapper_t<wf::activatorbinding_t> dump_trace_binding{"bench/dump_trace"};
+
+  public:
+    void init() override
+    {
+        this->init_output_tracking();
+        wf::get_core().bindings->add_activator(toggle_trace_binding, &on_toggle_trace);
+        wf::get_core().bindings->add_activator(dump_trace_binding, &on_dump_trace);
+        ipc_repo->register_method("bench/get-stats", on_ipc_get_stats);
+        ipc_repo->register_method("bench/watch", on_ipc_watch);
+        ipc_repo->register_method("bench/unwatch", on_ipc_unwatch);
+        ipc_repo->register_method("bench/trace", on_ipc_trace);
+        ipc_repo->register_method("bench/load", on_ipc_load);
+        ipc_repo->connect(&on_client_disconnected);
+        wf::get_core().connect(&on_pointer_motion);
+        wf::get_core().connect(&on_pointer_motion_absolute);
+        wf::get_core().connect(&on_keyboard_key);
+    }
+
+    void record_input(wf::output_t *output)
+    {
+        auto instance = output_instance.find(output);
+        if (instance != output_instance.end())
+        {
+            instance->second->record_input();
+        }
+    }
+
+    void record_pointer_input()
+    {
+        auto cursor = wf::get_core().get_cursor_position();
+        record_input(wf::get_core().output_layout->get_output_at(cursor.x, cursor.y));
+    }
+
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_motion_event>> on_pointer_motion =
+        [=] (wf::post_input_event_signal<wlr_pointer_motion_event> *ev)
+    {
+        record_pointer_input();
+    };
+
+    /* Tablets, touchscreens in pointer mode and nested sessions move the
+     * pointer with absolute motion */
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_pointer_motion_absolute_event>>
+    on_pointer_motion_absolute =
+        [=] (wf::post_input_event_signal<wlr_pointer_motion_absolute_event> *ev)
+    {
+        record_pointer_input();
+    };
+
+    wf::signal::connection_t<wf::post_input_event_signal<wlr_keyboard_key_event>> on_keyboard_key =
+        [=] (wf::post_input_event_signal<wlr_keyboard_key_event> *ev)
+    {
+        if (ev->event->state == WL_KEYBOARD_KEY_STATE_PRESSED)
+        {
+            record_input(wf::get_core().seat->get_active_output());
+        }
+    };
+
+    void handle_new_output(wf::output_t *output) override
+    {
+        per_output_tracker_mixin_t::handle_new_output(output);
+        auto instance = output_instance[output].get();
+        instance->frame_presented = [=] ()
+        {
+            notify_watchers(instance);
+        };
+
+        if (trace.is_recording())
+        {
+            instance->set_trace(&trace);
+            update_trace_threads();
+        }
+    }
+
+    void update_trace_threads()
+    {
+        std::vector<std::pair<uint32_t, std::string>> threads;
+        for (auto& [output, instance] : output_instance)
+        {
+            threads.push_back({output->get_id(), output->to_string()});
+        }
+
+        trace.set_threads(threads);
+    }
+
+    bool start_trace()
+    {
+        if (!trace.start(trace_file, size_t(std::max<int>(trace_buffer_size, 1)) * 1024))
+        {
+            return false;
+        }
+
+        update_trace_threads();
+        for (auto& [output, instance] : output_instance)
+        {
+            instance->set_trace(&trace);
+        }
+
+        return true;
+    }
+
+    void stop_trace()
+    {
+        for (auto& [output, instance] : output_instance)
+        {
+            instance->set_trace(nullptr);
+        }
+
+        trace.stop();
+    }
+
+    std::string format_dump_file_name()
+    {
+        char file_name[255];
+        auto time = std::time(nullptr);
+        std::strftime(file_name, sizeof(file_name),
+            trace_dump_file.value().c_str(), std::localtime(&time));
+        return file_name;
+    }
+
+    wf::activator_callback on_toggle_trace = [=] (auto)
+    {
+        if (trace.is_recording())
+        {
+            stop_trace();
+            return true;
+        }
+
+        return start_trace();
+    };
+
+    wf::activator_callback on_dump_trace = [=] (auto)
+    {
+        return trace.dump(format_dump_file_name(), 0);
+    };
+
+    wf::ipc::method_callback on_ipc_load = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto enabled   = wf::ipc::json_get_bool(data, "enabled");
+        auto output_id = wf::ipc::json_get_optional_uint64(data, "output-id");
+
+        bool found = false;
+        for (auto& [output, instance] : output_instance)
+        {
+            if (output_id.has_value() && (output->get_id() != output_id.value()))
+            {
+                continue;
+            }
+
+            instance->set_load(enabled);
+            found = true;
+        }
+
+        if (!found)
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        return wf::ipc::json_ok();
+    };
+
+    wf::ipc::method_callback on_ipc_trace = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto action = wf::ipc::json_get_string(data, "action");
+
+        if (action == "start")
+        {
+            if (!trace.is_recording() && !start_trace())
+            {
+                return wf::ipc::json_error("Failed to start recording, see the log for details.");
+            }
+
+            return wf::ipc::json_ok();
+        }
+
+        if (action == "stop")
+        {
+            stop_trace();
+            return wf::ipc::json_ok();
+        }
+
+        if (action == "dump")
+        {
+            auto file    = wf::ipc::json_get_optional_string(data, "file").value_or(format_dump_file_name());
+            auto seconds = wf::ipc::json_get_optional_uint64(data, "seconds").value_or(0);
+            if (!trace.is_recording())
+            {
+                return wf::ipc::json_error("Not recording.");
+            }
+
+            if (!trace.dump(file, seconds))
+            {
+                return wf::ipc::json_error("Failed to write trace dump.");
+            }
+
+            auto response = wf::ipc::json_ok();
+            response["file"] = file;
+            return response;
+        }
+
+        return wf::ipc::json_error("Unknown action, expected start, stop or dump.");
+    };
+
+    void notify_watchers(wayfire_bench_screen *instance)
+    {
+        if (watchers.empty())
+        {
+            return;
+        }
+
+        wf::json_t event;
+        bool have_event = false;
+        for (auto& [client, interval] : watchers)
+        {
+            if (instance->get_frame_count() % interval)
+            {
+                continue;
+            }
+
+            if (!have_event)
+            {
+                event["event"]  = "bench-stats";
+                event["output"] = instance->get_stats(false);
+                have_event = true;
+            }
+
+            client->send_json(event);
+        }
+    }
+
+    wf::ipc::method_callback on_ipc_get_stats = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto output_id = wf::ipc::json_get_optional_uint64(data, "output-id");
+        bool histogram = wf::ipc::json_get_optional_bool(data, "histogram").value_or(true);
+
+        wf::json_t outputs = wf::json_t::array();
+        for (auto& [output, instance] : output_instance)
+        {
+            if (output_id.has_value() && (output->get_id() != output_id.value()))
+            {
+                continue;
+            }
+
+            outputs.append(instance->get_stats(histogram));
+        }
+
+        if (output_id.has_value() && (outputs.size() == 0))
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        auto response = wf::ipc::json_ok();
+        response["outputs"] = outputs;
+        return response;
+    };
+
+    wf::ipc::method_callback_full on_ipc_watch =
+        [=] (wf::json_t data, wf::ipc::client_interface_t *client) -> wf::json_t
+    {
+        auto frames = wf::ipc::json_get_optional_uint64(data, "frames").value_or(60);
+        if (frames == 0)
+        {
+            return wf::ipc::json_error("frames must be greater than zero");
+        }
+
+        watchers[client] = frames;
+        return wf::ipc::json_ok();
+    };
+
+    wf::ipc::method_callback_full on_ipc_unwatch =
+        [=] (wf::json_t data, wf::ipc::client_interface_t *client) -> wf::json_t
+    {
+        watchers.erase(client);
+        return wf::ipc::json_ok();
+    };
+
+    wf::signal::connection_t<wf::ipc::client_disconnected_signal> on_client_disconnected =
+        [=] (wf::ipc::client_disconnected_signal *ev)
+    {
+        watchers.erase(ev->client);
+    };
+
+    void fini() override
+    {
+        ipc_repo->unregister_method("bench/get-stats");
+        ipc_repo->unregister_method("bench/watch");
+        ipc_repo->unregister_method("bench/unwatch");
+        ipc_repo->unregister_method("bench/trace");
+        ipc_repo->unregister_method("bench/load");
+        wf::get_core().bindings->rem_binding(&on_toggle_trace);
+        wf::get_core().bindings->rem_binding(&on_dump_trace);
+        stop_trace();
+        this->fini_output_tracking();
+    }
+};
+
+DECLARE_WAYFIRE_PLUGIN(wayfire_bench);
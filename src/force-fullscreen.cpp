@@ -154,6 +154,12 @@ class fullscreen_background
     std::shared_ptr<black_border_node_t> black_border_node;
     bool black_border = false;
     wf::geometry_t transformed_view_box;
+    /* Size the view was asked to take with resize_view */
+    wf::dimensions_t requested_size = {0, 0};
+    /* The view has the requested size and is shown without the transformer */
+    bool resized = false;
+    /* The view did not take the requested size, so it is scaled instead */
+    bool resize_refused = false;
 
     fullscreen_background(wayfire_toplevel_view view)
     {}
@@ -178,6 +184,7 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
         "force-fullscreen/constraint_area"};
     wf::option_wrapper_t<bool> transparent_behind_views{
         "force-fullscreen/transparent_behind_views"};
+    wf::option_wrapper_t<bool> resize_view{"force-fullscreen/resize_view"};
     wf::option_wrapper_t<wf::keybinding_t> key_toggle_fullscreen{
         "force-fullscreen/key_toggle_fullscreen"};
     wf::plugin_activation_data_t grab_interface{
@@ -195,6 +202,7 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
         wayfire_force_fullscreen_instances[output] = this;
         constrain_pointer.set_callback(constrain_pointer_option_changed);
         preserve_aspect.set_callback(option_changed);
+        resize_view.set_callback(option_changed);
         output->connect(&viewport_changed);
     }
 
@@ -207,6 +215,11 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
 
             for (auto& b : backgrounds)
             {
+                if (!b.second->black_border_node)
+                {
+                    continue;
+                }
+
                 int w   = (og.width - b.second->transformed_view_box.width) / 2.0f;
                 auto ws = output->wset()->get_view_main_workspace(b.first);
                 auto offset = ws - nvp;
@@ -271,8 +284,105 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
         }
     }
 
+    void attach_transformer(wayfire_toplevel_view view)
+    {
+        auto& background = backgrounds[view];
+        if (!view->get_transformed_node()->get_transformer(background_name))
+        {
+            view->get_transformed_node()->add_transformer(background->transformer,
+                wf::TRANSFORMER_2D, background_name);
+        }
+
+        /* The transformer centers the view itself */
+        if (background->resized)
+        {
+            background->resized = false;
+            view->move(0, 0);
+        }
+    }
+
+    /* Returns the box a view resized with resize_view is shown in: the whole
+     * output, or the largest centered box with the view's aspect ratio */
+    wf::geometry_t get_resize_box(wayfire_toplevel_view view)
+    {
+        auto og = output->get_relative_geometry();
+        auto vg = backgrounds[view]->undecorated_geometry;
+        if (!preserve_aspect || (vg.width <= 0) || (vg.height <= 0))
+        {
+            return og;
+        }
+
+        double scale = std::min((double)og.width / vg.width, (double)og.height / vg.height);
+        wf::geometry_t box;
+        box.width  = std::min<int>(std::round(vg.width * scale), og.width);
+        box.height = std::min<int>(std::round(vg.height * scale), og.height);
+        box.x = (og.width - box.width) / 2;
+        box.y = (og.height - box.height) / 2;
+        return box;
+    }
+
+    /*
+     * With resize_view, asks the view to render at the size it is shown at,
+     * so that its buffers can be shown as they are, and scanned out directly
+     * if it covers the whole output. Returns true if the view already has
+     * that size, otherwise it is scaled until it commits a buffer of the
+     * requested size.
+     */
+    bool try_resize(wayfire_toplevel_view view)
+    {
+        auto& background = backgrounds[view];
+        if (!resize_view || background->resize_refused)
+        {
+            return false;
+        }
+
+        auto box = get_resize_box(view);
+        auto vg  = view->get_geometry();
+        background->requested_size = {box.width, box.height};
+        if ((vg.width == box.width) && (vg.height == box.height))
+        {
+            show_resized(view);
+            return true;
+        }
+
+        view->resize(box.width, box.height);
+        return false;
+    }
+
+    /* Shows a view which has the requested size without the transformer */
+    void show_resized(wayfire_toplevel_view view)
+    {
+        auto& background = backgrounds[view];
+        auto og  = output->get_relative_geometry();
+        auto box = get_resize_box(view);
+
+        if (view->get_transformed_node()->get_transformer(background_name))
+        {
+            view->get_transformed_node()->rem_transformer(background->transformer);
+        }
+
+        background->resized = true;
+        background->transformed_view_box = box;
+
+        destroy_subsurface(view);
+        if (box != og)
+        {
+            ensure_subsurface(view, box);
+        }
+
+        auto vg = view->get_geometry();
+        if ((vg.x != box.x) || (vg.y != box.y))
+        {
+            view->move(box.x, box.y);
+        }
+
+        view->damage();
+    }
+
     void setup_transform(wayfire_toplevel_view view)
     {
+        attach_transformer(view);
+
         auto og = output->get_relative_geometry();
         auto vg = view->get_geometry();
 
@@ -318,7 +428,20 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
         for (auto& b : backgrounds)
         {
             destroy_subsurface(b.first);
-            setup_transform(b.first);
+
+            /* Give the view another chance to take the new size */
+            b.second->resize_refused = false;
+            if (!resize_view && b.second->requested_size.width)
+            {
+                b.second->requested_size = {0, 0};
+                b.first->resize(b.second->undecorated_geometry.width,
+                    b.second->undecorated_geometry.height);
+            }
+
+            if (!try_resize(b.first))
+            {
+                setup_transform(b.first);
+            }
         }
     }
 
@@ -360,7 +483,10 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
         background->second->undecorated_geometry = undecorated_geometry;
         background->second->saved_geometry = saved_geometry;
 
-        setup_transform(view);
+        if (!try_resize(view))
+        {
+            setup_transform(view);
+        }
 
         return true;
     }
@@ -421,6 +547,11 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
         view->move(
             background->second->saved_geometry.x,
             background->second->saved_geometry.y);
+        if (background->second->requested_size.width)
+        {
+            view->resize(background->second->undecorated_geometry.width,
+                background->second->undecorated_geometry.height);
+        }
 
         if (view->get_transformed_node()->get_transformer(background_name))
         {
@@ -628,9 +759,32 @@ class wayfire_force_fullscreen : public wf::per_output_plugin_instance_t
                 return;
             }
 
+            auto& b = background->second;
+            auto vg = view->get_geometry();
+            if (resize_view && !b->resize_refused)
+            {
+                if ((vg.width == b->requested_size.width) && (vg.height == b->requested_size.height))
+                {
+                    show_resized(view);
+                    return;
+                }
+
+                if ((vg.width == b->undecorated_geometry.width) &&
+                    (vg.height == b->undecorated_geometry.height) && !b->resized)
+                {
+                    /* The view has not taken the requested size yet */
+                    setup_transform(view);
+                    return;
+                }
+
+                /* The view chose a size of its own, scale it to the output */
+                b->resize_refused = true;
+                b->requested_size = {0, 0};
+            }
+
             view->resize(
-                background->second->undecorated_geometry.width,
-                background->second->undecorated_geometry.height);
+                b->undecorated_geometry.width,
+                b->undecorated_geometry.height);
             setup_transform(view);
         }
     };
@@ -0,0 +1,178 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Wayfire
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Replays a damage recording made by showrepaint and prints statistics
+ * about it: how much of the output is damaged and repainted per frame, how
+ * much more is repainted than damaged, and how fragmented the damage is.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include "showrepaint-recording.hpp"
+
+using namespace damage_recording;
+
+struct region_stats_t
+{
+    /* Per frame, in percent of the output area */
+    std::vector<double> coverage;
+    std::vector<size_t> rect_counts;
+    /* Per non-empty frame, area divided by the area of the bounding box */
+    std::vector<double> fill_ratios;
+    double total_area  = 0;
+    size_t empty_frames = 0;
+    size_t full_frames  = 0;
+
+    void add(const std::vector<rect_t>& rects, int32_t output_width, int32_t output_height)
+    {
+        double area = 0;
+        int32_t x1 = INT32_MAX, y1 = INT32_MAX, x2 = INT32_MIN, y2 = INT32_MIN;
+        for (auto& rect : rects)
+        {
+            area += (double)rect.width * rect.height;
+            x1    = std::min(x1, rect.x);
+            y1    = std::min(y1, rect.y);
+            x2    = std::max(x2, rect.x + rect.width);
+            y2    = std::max(y2, rect.y + rect.height);
+        }
+
+        double output_area = std::max(1.0, (double)output_width * output_height);
+        coverage.push_back(100.0 * area / output_area);
+        rect_counts.push_back(rects.size());
+        total_area += area;
+
+        if (rects.empty())
+        {
+            empty_frames++;
+            return;
+        }
+
+        fill_ratios.push_back(area / ((double)(x2 - x1) * (y2 - y1)));
+        if (area >= output_area)
+        {
+            full_frames++;
+        }
+    }
+};
+
+template<class T>
+static double percentile(std::vector<T> values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+
+    size_t index = std::min(values.size() - 1, (size_t)(p / 100.0 * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+template<class T>
+static double mean(const std::vector<T>& values)
+{
+    double sum = 0;
+    for (auto value : values)
+    {
+        sum += value;
+    }
+
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static void print_region_stats(const char *name, const region_stats_t& stats)
+{
+    printf("%s damage:\n", name);
+    printf("  output coverage   mean %.2f%%  p50 %.2f%%  p95 %.2f%%  max %.2f%%\n",
+        mean(stats.coverage), percentile(stats.coverage, 50),
+        percentile(stats.coverage, 95), percentile(stats.coverage, 100));
+    printf("  total area        %.1f Mpx\n", stats.total_area / 1e6);
+    printf("  empty frames      %zu\n", stats.empty_frames);
+    printf("  full frames       %zu\n", stats.full_frames);
+    printf("  rects per frame   mean %.1f  p95 %.0f  max %.0f\n",
+        mean(stats.rect_counts), percentile(stats.rect_counts, 95),
+        percentile(stats.rect_counts, 100));
+    printf("  bounding box fill mean %.2f  p5 %.2f\n",
+        mean(stats.fill_ratios), percentile(stats.fill_ratios, 5));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <recording>\n", argv[0]);
+        return 1;
+    }
+
+    reader_t reader;
+    if (!reader.open(argv[1]))
+    {
+        fprintf(stderr, "%s: not a damage recording\n", argv[1]);
+        return 1;
+    }
+
+    frame_t frame;
+    region_stats_t scheduled, swap;
+    std::vector<double> frame_times;
+    int64_t last_time = 0;
+    size_t frames     = 0;
+    int32_t width     = 0, height = 0;
+    while (reader.next(frame))
+    {
+        if (frames > 0)
+        {
+            frame_times.push_back((frame.time - last_time) / 1000.0);
+        }
+
+        scheduled.add(frame.scheduled, frame.output_width, frame.output_height);
+        swap.add(frame.swap, frame.output_width, frame.output_height);
+        last_time = frame.time;
+        width     = frame.output_width;
+        height    = frame.output_height;
+        frames++;
+    }
+
+    if (frames == 0)
+    {
+        printf("No frames recorded.\n");
+        return 0;
+    }
+
+    double seconds = last_time / 1e6;
+    printf("Output            %dx%d\n", width, height);
+    printf("Frames            %zu in %.2f s, %.1f fps\n", frames, seconds,
+        seconds > 0 ? (frames - 1) / seconds : 0.0);
+    printf("Frame interval    mean %.2f ms  p50 %.2f ms  p99 %.2f ms  max %.2f ms\n",
+        mean(frame_times), percentile(frame_times, 50), percentile(frame_times, 99),
+        percentile(frame_times, 100));
+    print_region_stats("Scheduled", scheduled);
+    print_region_stats("Swap", swap);
+
+    /* Repainted pixels per damaged pixel, 1.0 means nothing was repainted
+     * without being damaged */
+    printf("Overdraw          %.2f\n",
+        scheduled.total_area > 0 ? swap.total_area / scheduled.total_area : 0.0);
+    return 0;
+}
@@ -0,0 +1,366 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Wayfire
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Damage recordings written by showrepaint and read by
+ * wf-showrepaint-analyze. This header has no dependencies besides libc, so
+ * that the analyzer can be built without wayfire.
+ *
+ * File layout, all integers little endian:
+ *
+ *   header: "WFDAMAGE", u32 version, i32 output width, i32 output height
+ *   records, each starting with a type byte:
+ *     RECORD_FRAME:  varint microseconds since the previous frame,
+ *                    scheduled damage rects, swap damage rects
+ *     RECORD_RESIZE: varint output width, varint output height
+ *
+ * A list of rects is a varint count followed by each rect as zigzag varint
+ * x and y relative to the previous rect of the list, then varint width and
+ * height. Damage regions are sorted into bands, so consecutive rects are
+ * close and most deltas fit into a single byte.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+namespace damage_recording
+{
+static const char MAGIC[8] = {'W', 'F', 'D', 'A', 'M', 'A', 'G', 'E'};
+static const uint32_t VERSION = 1;
+static const size_t HEADER_SIZE = 20;
+/* Buffered data is written out once it grows over this size */
+static const size_t FLUSH_SIZE = 64 * 1024;
+
+enum record_type : uint8_t
+{
+    RECORD_FRAME  = 1,
+    RECORD_RESIZE = 2,
+};
+
+struct rect_t
+{
+    int32_t x, y, width, height;
+};
+
+struct frame_t
+{
+    /* Microseconds since the first frame */
+    int64_t time;
+    int32_t output_width;
+    int32_t output_height;
+    std::vector<rect_t> scheduled;
+    std::vector<rect_t> swap;
+};
+
+inline void put_u32(std::vector<uint8_t>& out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out.push_back(value >> (i * 8));
+    }
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+
+    out.push_back(value);
+}
+
+inline void put_svarint(std::vector<uint8_t>& out, int64_t value)
+{
+    put_varint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+inline void put_rects(std::vector<uint8_t>& out, const std::vector<rect_t>& rects)
+{
+    int32_t x = 0, y = 0;
+    put_varint(out, rects.size());
+    for (auto& rect : rects)
+    {
+        put_svarint(out, (int64_t)rect.x - x);
+        put_svarint(out, (int64_t)rect.y - y);
+        put_varint(out, rect.width);
+        put_varint(out, rect.height);
+        x = rect.x;
+        y = rect.y;
+    }
+}
+
+inline bool get_u32(const uint8_t*& pos, const uint8_t *end, uint32_t& value)
+{
+    if (end - pos < 4)
+    {
+        return false;
+    }
+
+    value = pos[0] | (pos[1] << 8) | (pos[2] << 16) | ((uint32_t)pos[3] << 24);
+    pos  += 4;
+    return true;
+}
+
+inline bool get_varint(const uint8_t*& pos, const uint8_t *end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool get_svarint(const uint8_t*& pos, const uint8_t *end, int64_t& value)
+{
+    uint64_t encoded;
+    if (!get_varint(pos, end, encoded))
+    {
+        return false;
+    }
+
+    value = (encoded >> 1) ^ -(int64_t)(encoded & 1);
+    return true;
+}
+
+inline bool get_rects(const uint8_t*& pos, const uint8_t *end, std::vector<rect_t>& rects)
+{
+    uint64_t count;
+    if (!get_varint(pos, end, count) || (count > (uint64_t)(end - pos)))
+    {
+        return false;
+    }
+
+    int64_t x = 0, y = 0;
+    rects.clear();
+    for (uint64_t i = 0; i < count; i++)
+    {
+        int64_t dx, dy;
+        uint64_t width, height;
+        if (!get_svarint(pos, end, dx) || !get_svarint(pos, end, dy) ||
+            !get_varint(pos, end, width) || !get_varint(pos, end, height))
+        {
+            return false;
+        }
+
+        x += dx;
+        y += dy;
+        rects.push_back({(int32_t)x, (int32_t)y, (int32_t)width, (int32_t)height});
+    }
+
+    return true;
+}
+
+/* Append-only writer, which buffers records and writes them out in chunks. */
+class writer_t
+{
+    int fd = -1;
+    int64_t last_time = 0;
+    std::vector<uint8_t> buffer;
+
+  public:
+    ~writer_t()
+    {
+        close();
+    }
+
+    bool open(const std::string& path, int32_t width, int32_t height)
+    {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        buffer.clear();
+        buffer.insert(buffer.end(), MAGIC, MAGIC + sizeof(MAGIC));
+        put_u32(buffer, VERSION);
+        put_u32(buffer, width);
+        put_u32(buffer, height);
+        last_time = 0;
+        return flush();
+    }
+
+    bool is_open()
+    {
+        return fd >= 0;
+    }
+
+    /* time in microseconds, on any monotonic clock */
+    void frame(int64_t time, const std::vector<rect_t>& scheduled, const std::vector<rect_t>& swap)
+    {
+        buffer.push_back(RECORD_FRAME);
+        put_varint(buffer, last_time ? time - last_time : 0);
+        put_rects(buffer, scheduled);
+        put_rects(buffer, swap);
+        last_time = time;
+
+        if (buffer.size() >= FLUSH_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void resize(int32_t width, int32_t height)
+    {
+        buffer.push_back(RECORD_RESIZE);
+        put_varint(buffer, width);
+        put_varint(buffer, height);
+    }
+
+    bool flush()
+    {
+        size_t written = 0;
+        while (fd >= 0 && written < buffer.size())
+        {
+            ssize_t ret = write(fd, buffer.data() + written, buffer.size() - written);
+            if (ret < 0)
+            {
+                buffer.clear();
+                return false;
+            }
+
+            written += ret;
+        }
+
+        buffer.clear();
+        return true;
+    }
+
+    bool close()
+    {
+        if (fd < 0)
+        {
+            return true;
+        }
+
+        bool ok = flush();
+        ok &= ::close(fd) == 0;
+        fd  = -1;
+        return ok;
+    }
+};
+
+/* Reads a whole recording into memory and replays it frame by frame. */
+class reader_t
+{
+    std::vector<uint8_t> data;
+    const uint8_t *pos = nullptr;
+    int32_t width  = 0;
+    int32_t height = 0;
+    int64_t time   = 0;
+
+  public:
+    bool open(const std::string& path)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            return false;
+        }
+
+        uint8_t chunk[FLUSH_SIZE];
+        size_t len;
+        data.clear();
+        while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        {
+            data.insert(data.end(), chunk, chunk + len);
+        }
+
+        fclose(file);
+
+        if ((data.size() < HEADER_SIZE) || memcmp(data.data(), MAGIC, sizeof(MAGIC)))
+        {
+            return false;
+        }
+
+        uint32_t version, w, h;
+        pos = data.data() + sizeof(MAGIC);
+        if (!get_u32(pos, data.data() + data.size(), version) || (version != VERSION) ||
+            !get_u32(pos, data.data() + data.size(), w) ||
+            !get_u32(pos, data.data() + data.size(), h))
+        {
+            return false;
+        }
+
+        width  = w;
+        height = h;
+        time   = 0;
+        return true;
+    }
+
+    /* Returns false at the end of the recording, or if it is truncated */
+    bool next(frame_t& frame)
+    {
+        const uint8_t *end = data.data() + data.size();
+        while (pos < end)
+        {
+            uint8_t type = *pos++;
+            if (type == RECORD_RESIZE)
+            {
+                uint64_t w, h;
+                if (!get_varint(pos, end, w) || !get_varint(pos, end, h))
+                {
+                    return false;
+                }
+
+                width  = w;
+                height = h;
+                continue;
+            }
+
+            uint64_t delta;
+            if ((type != RECORD_FRAME) || !get_varint(pos, end, delta) ||
+                !get_rects(pos, end, frame.scheduled) || !get_rects(pos, end, frame.swap))
+            {
+                return false;
+            }
+
+            time += delta;
+            frame.time = time;
+            frame.output_width  = width;
+            frame.output_height = height;
+            return true;
+        }
+
+        return false;
+    }
+};
+}
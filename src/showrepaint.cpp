@@ -22,25 +22,361 @@
  * SOFTWARE.
  */
 
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
 #include <wayfire/plugin.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/opengl.hpp>
 #include <wayfire/render-manager.hpp>
 #include <wayfire/per-output-plugin.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/plugins/common/cairo-util.hpp>
+#include <wayfire/plugins/common/shared-core-data.hpp>
+#include <wayfire/plugins/ipc/ipc-helpers.hpp>
+#include <wayfire/plugins/ipc/ipc-method-repository.hpp>
 
 #include <wayfire/util/log.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
 
 extern "C"
 {
 #include <EGL/egl.h>
 }
 
+#include "showrepaint-recording.hpp"
+
+/* Heat added to a tile for each frame it is damaged in */
+#define HEAT_UNIT 256
+/* Number of colors the heatmap is drawn with */
+#define HEAT_LEVELS 16
+
+/* Number of buckets the damage attribution window is split into */
+#define ATTRIBUTION_BUCKETS 10
+/* How often the label over the worst damage offender is updated, in ms */
+#define ATTRIBUTION_LABEL_INTERVAL 500
+#define LABEL_FONT_SIZE 16
+#define LABEL_PADDING 6
+
+static int64_t get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ll + ts.tv_nsec / 1000000;
+}
+
+static int64_t get_time_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
+static std::string replace_all(std::string s, const std::string& from, const std::string& to)
+{
+    for (size_t i = 0; i < s.size();)
+    {
+        auto pos = s.find(from, i);
+        if (pos == std::string::npos)
+        {
+            return s;
+        }
+
+        s.replace(pos, from.size(), to);
+        i = pos + to.size();
+    }
+
+    return s;
+}
+
+/*
+ * Damage accumulated over time on a grid of tiles. Every frame, each tile
+ * touched by the damage gains HEAT_UNIT, and all tiles decay exponentially
+ * with the configured half-life. A tile damaged on every frame therefore
+ * settles at a heat proportional to the frame rate.
+ */
+class damage_heatmap_t
+{
+  public:
+    struct hotspot_t
+    {
+        wf::geometry_t box;
+        /* Frames per second the tile was damaged in, recently */
+        double rate;
+    };
+
+  private:
+    int tile_size   = 0;
+    int width       = 0;
+    int height      = 0;
+    int grid_width  = 0;
+    int grid_height = 0;
+    int64_t last_decay = 0;
+    std::vector<uint32_t> heat;
+    /* Level each tile was last drawn with, and the tiles of each level */
+    std::vector<uint8_t> levels;
+    std::vector<wf::regionf_t> level_regions;
+
+    /* Merges runs of equal tiles in a row into one box */
+    template<class Pred>
+    void add_runs(int row, wf::regionf_t& region, Pred pred)
+    {
+        for (int x = 0; x < grid_width;)
+        {
+            if (!pred(row * grid_width + x))
+            {
+                x++;
+                continue;
+            }
+
+            int start = x;
+            while (x < grid_width && pred(row * grid_width + x))
+            {
+                x++;
+            }
+
+            region |= get_box(start, row, x - start);
+        }
+    }
+
+    wf::geometry_t get_box(int x, int y, int tiles)
+    {
+        wf::geometry_t box{x * tile_size, y * tile_size, tiles * tile_size, tile_size};
+        box.width  = std::min(box.width, width - box.x);
+        box.height = std::min(box.height, height - box.y);
+        return box;
+    }
+
+  public:
+    void resize(int new_width, int new_height, int new_tile_size)
+    {
+        if ((new_width == width) && (new_height == height) && (new_tile_size == tile_size))
+        {
+            return;
+        }
+
+        width  = new_width;
+        height = new_height;
+        tile_size   = std::max(new_tile_size, 1);
+        grid_width  = (width + tile_size - 1) / tile_size;
+        grid_height = (height + tile_size - 1) / tile_size;
+        reset();
+    }
+
+    void reset()
+    {
+        heat.assign(grid_width * grid_height, 0);
+        levels.assign(grid_width * grid_height, 0);
+        level_regions.assign(HEAT_LEVELS + 1, wf::regionf_t{});
+        last_decay = 0;
+    }
+
+    void decay(int64_t now, int half_life)
+    {
+        int64_t elapsed = last_decay ? now - last_decay : 0;
+        uint64_t factor = lround(exp2(-(double)elapsed / half_life) * 65536);
+        if (last_decay && (factor >= 65536))
+        {
+            return;
+        }
+
+        last_decay = now;
+        for (auto& h : heat)
+        {
+            h = (h * factor) >> 16;
+        }
+    }
+
+    void add(const wf::regionf_t& damage)
+    {
+        for (const auto& box : damage)
+        {
+            int x1 = std::clamp<int>(floor(box.x / (double)tile_size), 0, grid_width);
+            int y1 = std::clamp<int>(floor(box.y / (double)tile_size), 0, grid_height);
+            int x2 = std::clamp<int>(ceil((box.x + box.width) / (double)tile_size), 0, grid_width);
+            int y2 = std::clamp<int>(ceil((box.y + box.height) / (double)tile_size), 0, grid_height);
+            for (int y = y1; y < y2; y++)
+            {
+                for (int x = x1; x < x2; x++)
+                {
+                    uint32_t& h = heat[y * grid_width + x];
+                    h = std::min<uint64_t>((uint64_t)h + HEAT_UNIT, UINT32_MAX);
+                }
+            }
+        }
+    }
+
+    /*
+     * Quantize the heat of each tile relative to full_heat, the heat of a
+     * tile damaged on every frame. The levels are only repainted where the
+     * output is damaged anyway, so the heatmap does not count itself.
+     */
+    void update_levels(double full_heat)
+    {
+        std::vector<uint8_t> old_levels = levels;
+        bool changed = false;
+        for (size_t i = 0; i < heat.size(); i++)
+        {
+            double ratio = std::min(1.0, heat[i] / full_heat);
+            levels[i] = ceil(sqrt(ratio) * HEAT_LEVELS);
+            changed  |= levels[i] != old_levels[i];
+        }
+
+        if (!changed)
+        {
+            return;
+        }
+
+        for (auto& region : level_regions)
+        {
+            region.clear();
+        }
+
+        for (int y = 0; y < grid_height; y++)
+        {
+            for (int level = 1; level <= HEAT_LEVELS; level++)
+            {
+                add_runs(y, level_regions[level], [&] (int i) { return levels[i] == level; });
+            }
+        }
+    }
+
+    const wf::regionf_t& get_level_region(int level)
+    {
+        return level_regions[level];
+    }
+
+    int get_tile_size()
+    {
+        return tile_size;
+    }
+
+    std::vector<hotspot_t> get_hottest(size_t count, int half_life)
+    {
+        std::vector<int> tiles;
+        for (size_t i = 0; i < heat.size(); i++)
+        {
+            if (heat[i])
+            {
+                tiles.push_back(i);
+            }
+        }
+
+        count = std::min(count, tiles.size());
+        std::partial_sort(tiles.begin(), tiles.begin() + count, tiles.end(),
+            [&] (int a, int b) { return heat[a] > heat[b]; });
+
+        /* A tile damaged at r frames per second settles at
+         * r * HEAT_UNIT * half_life / ln(2) */
+        std::vector<hotspot_t> hottest;
+        for (size_t i = 0; i < count; i++)
+        {
+            hottest.push_back({
+                get_box(tiles[i] % grid_width, tiles[i] / grid_width, 1),
+                heat[tiles[i]] * M_LN2 * 1000.0 / (HEAT_UNIT * (double)half_life)
+            });
+        }
+
+        return hottest;
+    }
+};
+
+/*
+ * Damage committed by the main surface of one view, summed over a sliding
+ * window. The window is split into buckets which are cleared as time moves
+ * past them, so adding damage and reading the sums are constant time.
+ */
+struct view_damage_t
+{
+    wayfire_view view;
+    wf::wl_listener_wrapper on_commit;
+    uint64_t area[ATTRIBUTION_BUCKETS] = {};
+    uint32_t commits[ATTRIBUTION_BUCKETS] = {};
+    int64_t last_bucket = 0;
+
+    void advance(int64_t bucket)
+    {
+        int64_t expired = std::min<int64_t>(bucket - last_bucket, ATTRIBUTION_BUCKETS);
+        for (int64_t i = 1; i <= expired; i++)
+        {
+            area[(last_bucket + i) % ATTRIBUTION_BUCKETS]    = 0;
+            commits[(last_bucket + i) % ATTRIBUTION_BUCKETS] = 0;
+        }
+
+        last_bucket = std::max(last_bucket, bucket);
+    }
+
+    void add(int64_t bucket, uint64_t damaged_area)
+    {
+        advance(bucket);
+        area[bucket % ATTRIBUTION_BUCKETS] += damaged_area;
+        commits[bucket % ATTRIBUTION_BUCKETS]++;
+    }
+
+    void reset()
+    {
+        std::fill(std::begin(area), std::end(area), 0);
+        std::fill(std::begin(commits), std::end(commits), 0);
+    }
+
+    uint64_t get_area(int64_t bucket)
+    {
+        advance(bucket);
+        uint64_t sum = 0;
+        for (auto a : area)
+        {
+            sum += a;
+        }
+
+        return sum;
+    }
+
+    uint64_t get_commits(int64_t bucket)
+    {
+        advance(bucket);
+        uint64_t sum = 0;
+        for (auto c : commits)
+        {
+            sum += c;
+        }
+
+        return sum;
+    }
+};
+
 class wayfire_showrepaint : public wf::per_output_plugin_instance_t
 {
     wf::option_wrapper_t<wf::activatorbinding_t> toggle_binding{"showrepaint/toggle"};
     wf::option_wrapper_t<bool> reduce_flicker{"showrepaint/reduce_flicker"};
+    wf::option_wrapper_t<std::string> mode{"showrepaint/mode"};
+    wf::option_wrapper_t<int> heatmap_tile_size{"showrepaint/heatmap_tile_size"};
+    wf::option_wrapper_t<int> heatmap_half_life{"showrepaint/heatmap_half_life"};
+    wf::option_wrapper_t<wf::activatorbinding_t> toggle_recording_binding{"showrepaint/toggle_recording"};
+    wf::option_wrapper_t<std::string> record_file{"showrepaint/record_file"};
     bool active, egl_swap_buffers_with_damage;
     wf::auxilliary_buffer_t last_buffer;
+    /* Whether last_buffer holds the previous frame, and the region which
+     * was repainted on top of it in the current frame */
+    bool last_buffer_valid = false;
+    wf::regionf_t frame_damage;
+    damage_heatmap_t heatmap;
+    /* Label over the view which currently damages the most */
+    std::unique_ptr<wf::owned_texture_t> talker_label;
+    wf::geometry_t talker_label_box = {0, 0, 0, 0};
+    /* What the label was last rasterized for */
+    wayfire_view talker_view = nullptr;
+    std::string talker_text;
+    /* Damage recording, independent of whether damage is shown */
+    damage_recording::writer_t recording;
+    std::string recording_path;
+    int32_t recording_width  = 0;
+    int32_t recording_height = 0;
+    std::vector<damage_recording::rect_t> recorded_scheduled, recorded_swap;
 
   public:
     void init() override
@@ -50,14 +386,35 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
             egl_extension_supported("EGL_KHR_swap_buffers_with_damage") ||
             egl_extension_supported("EGL_EXT_swap_buffers_with_damage");
         output->add_activator(toggle_binding, &toggle_cb);
+        output->add_activator(toggle_recording_binding, &toggle_recording_cb);
         reduce_flicker.set_callback(option_changed);
+        mode.set_callback(heatmap_changed);
+        heatmap_tile_size.set_callback(heatmap_changed);
     }
 
     wf::config::option_base_t::updated_callback_t option_changed = [=] ()
     {
+        last_buffer_valid = false;
+        output->render->damage_whole();
+    };
+
+    wf::config::option_base_t::updated_callback_t heatmap_changed = [=] ()
+    {
+        last_buffer_valid = false;
+        heatmap.reset();
         output->render->damage_whole();
     };
 
+    bool is_heatmap()
+    {
+        return (std::string)mode == "heatmap";
+    }
+
+    bool is_active()
+    {
+        return active;
+    }
+
     void set_active_status(bool status)
     {
         if (this->active == status)
@@ -67,15 +424,19 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
 
         if (status)
         {
+            output->render->add_effect(&heatmap_damage_hook, wf::OUTPUT_EFFECT_DAMAGE);
             output->render->add_effect(&overlay_hook, wf::OUTPUT_EFFECT_OVERLAY);
             output->render->add_effect(&on_main_pass_done, wf::OUTPUT_EFFECT_PASS_DONE);
         } else
         {
+            output->render->rem_effect(&heatmap_damage_hook);
             output->render->rem_effect(&overlay_hook);
             output->render->rem_effect(&on_main_pass_done);
         }
 
         this->active = status;
+        last_buffer_valid = false;
+        heatmap.reset();
     }
 
     wf::activator_callback toggle_cb = [=] (auto)
@@ -85,6 +446,93 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
         return true;
     };
 
+    bool is_recording()
+    {
+        return recording.is_open();
+    }
+
+    const std::string& get_recording_path()
+    {
+        return recording_path;
+    }
+
+    /* {output} in the path is replaced with the output name. Returns false if
+     * the file could not be opened. */
+    bool start_recording(std::string path)
+    {
+        stop_recording();
+        path = replace_all(path, "{output}", output->to_string());
+        auto geometry = output->get_relative_geometry();
+        if (!recording.open(path, geometry.width, geometry.height))
+        {
+            LOGE("showrepaint: failed to open ", path, " for recording");
+            return false;
+        }
+
+        recording_path   = path;
+        recording_width  = geometry.width;
+        recording_height = geometry.height;
+        output->render->add_effect(&record_hook, wf::OUTPUT_EFFECT_OVERLAY);
+        LOGI("showrepaint: recording damage of ", output->to_string(), " to ", path);
+        return true;
+    }
+
+    void stop_recording()
+    {
+        if (!recording.is_open())
+        {
+            return;
+        }
+
+        output->render->rem_effect(&record_hook);
+        if (!recording.close())
+        {
+            LOGE("showrepaint: failed to write ", recording_path);
+        }
+
+        recording_path.clear();
+    }
+
+    wf::activator_callback toggle_recording_cb = [=] (auto)
+    {
+        if (is_recording())
+        {
+            stop_recording();
+        } else
+        {
+            start_recording(record_file);
+        }
+
+        return true;
+    };
+
+    static void region_to_rects(const wf::regionf_t& region, std::vector<damage_recording::rect_t>& rects)
+    {
+        rects.clear();
+        for (const auto& box : region)
+        {
+            int x1 = floor(box.x);
+            int y1 = floor(box.y);
+            rects.push_back({x1, y1, (int)ceil(box.x + box.width) - x1, (int)ceil(box.y + box.height) - y1});
+        }
+    }
+
+    wf::effect_hook_t record_hook = [=] ()
+    {
+        auto target_fb = output->render->get_target_framebuffer();
+        if ((target_fb.geometry.width != recording_width) || (target_fb.geometry.height != recording_height))
+        {
+            recording_width  = target_fb.geometry.width;
+            recording_height = target_fb.geometry.height;
+            recording.resize(recording_width, recording_height);
+        }
+
+        region_to_rects(output->render->get_scheduled_damage(), recorded_scheduled);
+        region_to_rects(target_fb.geometry_region_from_framebuffer_region(
+            output->render->get_swap_damage()), recorded_swap);
+        recording.frame(get_time_us(), recorded_scheduled, recorded_swap);
+    };
+
     bool egl_extension_supported(std::string ext)
     {
         if (!wf::get_core().is_gles2())
@@ -116,8 +564,173 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
         color.a = 0.25;
     }
 
+    wf::effect_hook_t heatmap_damage_hook = [=] ()
+    {
+        if (!is_heatmap())
+        {
+            return;
+        }
+
+        auto og = output->get_relative_geometry();
+        heatmap.resize(og.width, og.height, heatmap_tile_size);
+        heatmap.decay(get_time_ms(), heatmap_half_life);
+
+        heatmap.add(output->render->get_scheduled_damage());
+
+        /* Heat of a tile damaged on every refresh cycle */
+        double refresh = output->handle->current_mode ?
+            output->handle->current_mode->refresh / 1000.0 : 60.0;
+        double full_heat = refresh * HEAT_UNIT * heatmap_half_life / 1000.0 / M_LN2;
+
+        heatmap.update_levels(full_heat);
+    };
+
+    void get_heat_color(int level, wf::color_t& color)
+    {
+        /* Blue for rarely damaged tiles through green to red */
+        double t = (level - 1) / (double)(HEAT_LEVELS - 1);
+        double alpha = 0.15 + 0.35 * t;
+        color.r = t * alpha;
+        color.g = (1.0 - fabs(2.0 * t - 1.0)) * alpha;
+        color.b = (1.0 - t) * alpha;
+        color.a = alpha;
+    }
+
+    void render_heatmap()
+    {
+        auto target_fb = output->render->get_target_framebuffer();
+        wf::regionf_t swap_damage = target_fb.geometry_region_from_framebuffer_region(
+            output->render->get_swap_damage());
+
+        auto rpass = output->render->get_current_pass();
+        wf::color_t color;
+        for (int level = 1; level <= HEAT_LEVELS; level++)
+        {
+            auto& region = heatmap.get_level_region(level);
+            if (region.empty())
+            {
+                continue;
+            }
+
+            get_heat_color(level, color);
+            rpass->add_rect(color, target_fb, target_fb.geometry, region & swap_damage);
+        }
+    }
+
+    wf::json_t get_hottest(size_t count)
+    {
+        wf::json_t hotspots = wf::json_t::array();
+        for (auto& spot : heatmap.get_hottest(count, heatmap_half_life))
+        {
+            wf::json_t hotspot;
+            hotspot["x"]      = spot.box.x;
+            hotspot["y"]      = spot.box.y;
+            hotspot["width"]  = spot.box.width;
+            hotspot["height"] = spot.box.height;
+            hotspot["damage-per-second"] = spot.rate;
+            hotspots.append(hotspot);
+        }
+
+        wf::json_t result;
+        result["output-id"]   = (uint64_t)output->get_id();
+        result["output-name"] = output->to_string();
+        result["active"]    = active && is_heatmap();
+        result["tile-size"] = heatmap.get_tile_size();
+        result["hotspots"]  = hotspots;
+        return result;
+    }
+
+    void set_talker_label(wayfire_view view, const std::string& text)
+    {
+        if (!view)
+        {
+            if (talker_label)
+            {
+                output->render->damage(talker_label_box);
+                output->render->rem_effect(&label_hook);
+                talker_label.reset();
+                talker_label_box = {0, 0, 0, 0};
+                talker_view = nullptr;
+                talker_text.clear();
+            }
+
+            return;
+        }
+
+        bool changed = false;
+        if (!talker_label || (view != talker_view) || (text != talker_text))
+        {
+            rasterize_talker_label(text);
+            talker_view = view;
+            talker_text = text;
+            changed     = true;
+        }
+
+        /* Top left corner of the view, kept on the output */
+        auto og   = output->get_relative_geometry();
+        auto bbox = view->get_bounding_box();
+        wf::geometry_t box = talker_label_box;
+        box.x = std::clamp(bbox.x, 0, std::max(0, og.width - box.width));
+        box.y = std::clamp(bbox.y, 0, std::max(0, og.height - box.height));
+        if (changed || (box != talker_label_box))
+        {
+            output->render->damage(talker_label_box);
+            talker_label_box = box;
+            output->render->damage(talker_label_box);
+        }
+    }
+
+    /* Draws the label texture and sets the size of its box */
+    void rasterize_talker_label(const std::string& text)
+    {
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+        cairo_t *cr = cairo_create(surface);
+        cairo_text_extents_t extents;
+        cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size(cr, LABEL_FONT_SIZE);
+        cairo_text_extents(cr, text.c_str(), &extents);
+        cairo_destroy(cr);
+        cairo_surface_destroy(surface);
+
+        int width  = extents.x_advance + LABEL_PADDING * 2;
+        int height = LABEL_FONT_SIZE + LABEL_PADDING * 2;
+        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+        cr = cairo_create(surface);
+        cairo_set_source_rgba(cr, 0.6, 0, 0, 0.8);
+        cairo_paint(cr);
+        cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size(cr, LABEL_FONT_SIZE);
+        cairo_set_source_rgba(cr, 1, 1, 1, 1);
+        cairo_move_to(cr, LABEL_PADDING, LABEL_PADDING - extents.y_bearing);
+        cairo_show_text(cr, text.c_str());
+        cairo_destroy(cr);
+
+        if (!talker_label)
+        {
+            output->render->add_effect(&label_hook, wf::OUTPUT_EFFECT_OVERLAY);
+        }
+
+        talker_label = std::make_unique<wf::owned_texture_t>(surface);
+        cairo_surface_destroy(surface);
+        talker_label_box.width  = width;
+        talker_label_box.height = height;
+    }
+
+    wf::effect_hook_t label_hook = [=] ()
+    {
+        auto target_fb = output->render->get_target_framebuffer();
+        output->render->get_current_pass()->add_texture(talker_label->get_texture(), target_fb,
+            talker_label_box, wf::regionf_t{talker_label_box});
+    };
+
     wf::effect_hook_t overlay_hook = [=] ()
     {
+        if (is_heatmap())
+        {
+            render_heatmap();
+            return;
+        }
+
         auto target_fb = output->render->get_target_framebuffer();
         wf::regionf_t swap_damage = target_fb.geometry_region_from_framebuffer_region(
             output->render->get_swap_damage());
@@ -138,6 +751,7 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
         get_random_color(color);
         damage = scheduled_damage.empty() ? swap_damage : scheduled_damage;
         inverted_damage = output_region ^ damage;
+        frame_damage    = damage;
 
         auto rpass = output->render->get_current_pass();
         rpass->add_rect(color, target_fb, target_fb.geometry, damage);
@@ -165,7 +779,7 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
          * this since the damage region that is passed to swap is only repainted. If it isn't supported, the
          * entire buffer is repainted.
          */
-        if (last_buffer.get_size().width > 0)
+        if (last_buffer_valid)
         {
             std::shared_ptr<wf::texture_t> texture = wf::texture_t::from_aux(last_buffer);
             texture->set_transform(target_fb.wl_transform);
@@ -175,7 +789,7 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
 
     wf::effect_hook_t on_main_pass_done = [=] ()
     {
-        if (!reduce_flicker || egl_swap_buffers_with_damage)
+        if (!reduce_flicker || egl_swap_buffers_with_damage || is_heatmap())
         {
             return;
         }
@@ -183,20 +797,345 @@ class wayfire_showrepaint : public wf::per_output_plugin_instance_t
         /*
          * Save the current buffer to last buffer so we can render the
          * inverted damage from the last buffer to the current buffer
-         * on next frame. We have to save the entire buffer because we
-         * don't know what the next frame damage will be.
+         * on next frame. The inverted damage of this frame was itself
+         * painted from last buffer, so only the damaged boxes differ and
+         * need to be copied. The whole buffer is only copied when last
+         * buffer was (re)allocated or does not hold the previous frame.
          */
         auto target_fb = output->render->get_target_framebuffer();
-        last_buffer.allocate(target_fb.get_size());
-        wf::geometry_t full = wf::construct_box({0, 0}, target_fb.get_size());
-        last_buffer.get_renderbuffer().blit(target_fb, full, full);
+        if ((last_buffer.allocate(target_fb.get_size()) == wf::buffer_reallocation_result_t::REALLOCATED) ||
+            !last_buffer_valid)
+        {
+            wf::geometry_t full = wf::construct_box({0, 0}, target_fb.get_size());
+            last_buffer.get_renderbuffer().blit(target_fb, full, full);
+            last_buffer_valid = true;
+            return;
+        }
+
+        for (const auto& box : target_fb.framebuffer_region_from_geometry_region(frame_damage))
+        {
+            int x1 = floor(box.x);
+            int y1 = floor(box.y);
+            wf::geometry_t fb_box{x1, y1, (int)ceil(box.x + box.width) - x1,
+                (int)ceil(box.y + box.height) - y1};
+            last_buffer.get_renderbuffer().blit(target_fb, fb_box, fb_box);
+        }
     };
 
     void fini() override
     {
         output->rem_binding(&toggle_cb);
+        output->rem_binding(&toggle_recording_cb);
+        stop_recording();
         set_active_status(false);
+        set_talker_label(nullptr, "");
+        last_buffer.free();
+    }
+};
+
+class wayfire_showrepaint_global : public wf::plugin_interface_t,
+    public wf::per_output_tracker_mixin_t<wayfire_showrepaint>
+{
+    wf::shared_data::ref_ptr_t<wf::ipc::method_repository_t> ipc_repo;
+    wf::option_wrapper_t<bool> attribution{"showrepaint/attribution"};
+    wf::option_wrapper_t<int> attribution_window{"showrepaint/attribution_window"};
+    wf::option_wrapper_t<bool> attribution_label{"showrepaint/attribution_label"};
+    wf::option_wrapper_t<std::string> record_file{"showrepaint/record_file"};
+    std::map<wayfire_view, std::unique_ptr<view_damage_t>> view_damage;
+    wf::wl_timer<true> label_timer;
+    bool attribution_enabled = false;
+
+  public:
+    void init() override
+    {
+        this->init_output_tracking();
+        ipc_repo->register_method("showrepaint/heatmap", on_ipc_heatmap);
+        ipc_repo->register_method("showrepaint/damage-talkers", on_ipc_damage_talkers);
+        ipc_repo->register_method("showrepaint/record", on_ipc_record);
+        attribution.set_callback(attribution_changed);
+        attribution_window.set_callback(attribution_window_changed);
+        attribution_label.set_callback(attribution_changed);
+        set_attribution(attribution);
+    }
+
+    /*
+     * Damage attribution. The damage each client commits on the main surface
+     * of its views is added up over a sliding window, independently of where
+     * and whether it ends up on screen.
+     */
+    void set_attribution(bool enabled)
+    {
+        if (enabled != attribution_enabled)
+        {
+            attribution_enabled = enabled;
+            view_damage.clear();
+            if (enabled)
+            {
+                wf::get_core().connect(&on_view_mapped);
+                wf::get_core().connect(&on_view_unmapped);
+                for (auto& view : wf::get_core().get_all_views())
+                {
+                    if (view->is_mapped())
+                    {
+                        track_view(view);
+                    }
+                }
+            } else
+            {
+                on_view_mapped.disconnect();
+                on_view_unmapped.disconnect();
+            }
+        }
+
+        label_timer.disconnect();
+        if (enabled && attribution_label)
+        {
+            label_timer.set_timeout(ATTRIBUTION_LABEL_INTERVAL, [=] ()
+            {
+                update_talker_label();
+                return true;
+            });
+        } else
+        {
+            for (auto& [output, instance] : output_instance)
+            {
+                instance->set_talker_label(nullptr, "");
+            }
+        }
+    }
+
+    int64_t get_bucket()
+    {
+        return get_time_ms() / std::max(1, attribution_window / ATTRIBUTION_BUCKETS);
+    }
+
+    void track_view(wayfire_view view)
+    {
+        wlr_surface *surface = view->get_wlr_surface();
+        if (!surface)
+        {
+            return;
+        }
+
+        auto tracker = std::make_unique<view_damage_t>();
+        tracker->view = view;
+        tracker->on_commit.set_callback([=, ptr = tracker.get()] (void*)
+        {
+            pixman_region32_t damage;
+            pixman_region32_init(&damage);
+            wlr_surface_get_effective_damage(surface, &damage);
+
+            int nrects;
+            uint64_t area = 0;
+            auto rects = pixman_region32_rectangles(&damage, &nrects);
+            for (int i = 0; i < nrects; i++)
+            {
+                area += (uint64_t)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+            }
+
+            pixman_region32_fini(&damage);
+            if (area)
+            {
+                ptr->add(get_bucket(), area);
+            }
+        });
+        tracker->on_commit.connect(&surface->events.commit);
+        view_damage[view] = std::move(tracker);
+    }
+
+    wf::signal::connection_t<wf::view_mapped_signal> on_view_mapped = [=] (wf::view_mapped_signal *ev)
+    {
+        track_view(ev->view);
+    };
+
+    wf::signal::connection_t<wf::view_unmapped_signal> on_view_unmapped =
+        [=] (wf::view_unmapped_signal *ev)
+    {
+        view_damage.erase(ev->view);
+    };
+
+    wf::config::option_base_t::updated_callback_t attribution_changed = [=] ()
+    {
+        set_attribution(attribution);
+    };
+
+    wf::config::option_base_t::updated_callback_t attribution_window_changed = [=] ()
+    {
+        /* The buckets change length, so what they hold is meaningless */
+        for (auto& [view, tracker] : view_damage)
+        {
+            tracker->reset();
+        }
+    };
+
+    /* Views sorted by the damage they committed in the window, most first */
+    std::vector<view_damage_t*> get_talkers()
+    {
+        int64_t bucket = get_bucket();
+        std::vector<std::pair<uint64_t, view_damage_t*>> sorted;
+        for (auto& [view, tracker] : view_damage)
+        {
+            uint64_t area = tracker->get_area(bucket);
+            if (area)
+            {
+                sorted.push_back({area, tracker.get()});
+            }
+        }
+
+        std::sort(sorted.begin(), sorted.end(),
+            [] (auto& a, auto& b) { return a.first > b.first; });
+
+        std::vector<view_damage_t*> talkers;
+        for (auto& [area, tracker] : sorted)
+        {
+            talkers.push_back(tracker);
+        }
+
+        return talkers;
+    }
+
+    void update_talker_label()
+    {
+        auto talkers = get_talkers();
+        wayfire_view worst = talkers.empty() ? nullptr : talkers.front()->view;
+        for (auto& [output, instance] : output_instance)
+        {
+            if (!worst || (worst->get_output() != output))
+            {
+                instance->set_talker_label(nullptr, "");
+                continue;
+            }
+
+            char buf[64];
+            double seconds = attribution_window / 1000.0;
+            snprintf(buf, sizeof(buf), ": %.1f Mpx/s, %.0f commits/s",
+                talkers.front()->get_area(get_bucket()) / seconds / 1e6,
+                talkers.front()->get_commits(get_bucket()) / seconds);
+            instance->set_talker_label(worst, worst->get_app_id() + buf);
+        }
+    }
+
+    wf::ipc::method_callback on_ipc_damage_talkers = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto count = wf::ipc::json_get_optional_uint64(data, "count").value_or(10);
+        if (!attribution_enabled)
+        {
+            return wf::ipc::json_error("Damage attribution is disabled.");
+        }
+
+        int64_t bucket = get_bucket();
+        double seconds = attribution_window / 1000.0;
+        wf::json_t talkers = wf::json_t::array();
+        for (auto tracker : get_talkers())
+        {
+            if (talkers.size() >= count)
+            {
+                break;
+            }
+
+            uint64_t area    = tracker->get_area(bucket);
+            uint64_t commits = tracker->get_commits(bucket);
+            wf::json_t talker;
+            talker["view-id"] = tracker->view->get_id();
+            talker["app-id"]  = tracker->view->get_app_id();
+            talker["title"]   = tracker->view->get_title();
+            talker["output-id"] = tracker->view->get_output() ?
+                (uint64_t)tracker->view->get_output()->get_id() : (uint64_t)0;
+            talker["area"] = area;
+            talker["pixels-per-second"]  = area / seconds;
+            talker["commits-per-second"] = commits / seconds;
+            talkers.append(talker);
+        }
+
+        auto response = wf::ipc::json_ok();
+        response["window-ms"] = (int)attribution_window;
+        response["talkers"]   = talkers;
+        return response;
+    };
+
+    /* The hottest tiles of each output, hottest first */
+    wf::ipc::method_callback on_ipc_heatmap = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto output_id = wf::ipc::json_get_optional_uint64(data, "output-id");
+        auto count     = wf::ipc::json_get_optional_uint64(data, "count").value_or(10);
+
+        wf::json_t outputs = wf::json_t::array();
+        for (auto& [output, instance] : output_instance)
+        {
+            if (output_id.has_value() && (output->get_id() != output_id.value()))
+            {
+                continue;
+            }
+
+            outputs.append(instance->get_hottest(count));
+        }
+
+        if (output_id.has_value() && (outputs.size() == 0))
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        auto response = wf::ipc::json_ok();
+        response["outputs"] = outputs;
+        return response;
+    };
+
+    /* Starts or stops damage recording, on one output or on all of them */
+    wf::ipc::method_callback on_ipc_record = [=] (wf::json_t data) -> wf::json_t
+    {
+        auto action    = wf::ipc::json_get_string(data, "action");
+        auto output_id = wf::ipc::json_get_optional_uint64(data, "output-id");
+        auto file = wf::ipc::json_get_optional_string(data, "file").value_or((std::string)record_file);
+        if ((action != "start") && (action != "stop"))
+        {
+            return wf::ipc::json_error("Unknown action, expected start or stop.");
+        }
+
+        wf::json_t outputs = wf::json_t::array();
+        for (auto& [output, instance] : output_instance)
+        {
+            if (output_id.has_value() && (output->get_id() != output_id.value()))
+            {
+                continue;
+            }
+
+            wf::json_t entry;
+            entry["output-id"]   = (uint64_t)output->get_id();
+            entry["output-name"] = output->to_string();
+            if (action == "start")
+            {
+                if (!instance->start_recording(file))
+                {
+                    return wf::ipc::json_error("Failed to start recording, see the log for details.");
+                }
+
+                entry["file"] = instance->get_recording_path();
+            } else
+            {
+                instance->stop_recording();
+            }
+
+            outputs.append(entry);
+        }
+
+        if (output_id.has_value() && (outputs.size() == 0))
+        {
+            return wf::ipc::json_error("No such output found!");
+        }
+
+        auto response = wf::ipc::json_ok();
+        response["outputs"] = outputs;
+        return response;
+    };
+
+    void fini() override
+    {
+        ipc_repo->unregister_method("showrepaint/heatmap");
+        ipc_repo->unregister_method("showrepaint/damage-talkers");
+        ipc_repo->unregister_method("showrepaint/record");
+        set_attribution(false);
+        this->fini_output_tracking();
     }
 };
 
-DECLARE_WAYFIRE_PLUGIN(wf::per_output_plugin_t<wayfire_showrepaint>);
+DECLARE_WAYFIRE_PLUGIN(wayfire_showrepaint_global);
@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <climits>
+#include <unordered_map>
 #include <wayfire/bindings.hpp>
 #include <wayfire/geometry.hpp>
 #include <wayfire/workarea.hpp>
@@ -42,6 +44,7 @@
 #include <wayfire/per-output-plugin.hpp>
 #include <wayfire/signal-definitions.hpp>
 #include <wayfire/plugins/common/cairo-util.hpp>
+#include <wayfire/plugins/common/shared-core-data.hpp>
 #include <wayfire/config/config-manager.hpp>
 
 #define WIDGET_PADDING 20
@@ -50,10 +53,129 @@ struct workspace_name
 {
     wf::geometry_t rect;
     std::string name;
-    std::unique_ptr<wf::owned_texture_t> texture;
-    cairo_t *cr = nullptr;
-    cairo_surface_t *cairo_surface;
-    cairo_text_extents_t text_extents;
+    std::shared_ptr<wf::owned_texture_t> texture;
+};
+
+/* Everything which affects how a label looks */
+struct workspace_name_style_t
+{
+    std::string text;
+    std::string font;
+    double font_size;
+    double radius;
+    wf::color_t text_color;
+    wf::color_t background_color;
+
+    auto fields() const
+    {
+        return std::tie(text, font, font_size, radius,
+            text_color.r, text_color.g, text_color.b, text_color.a,
+            background_color.r, background_color.g, background_color.b, background_color.a);
+    }
+
+    bool operator <(const workspace_name_style_t& other) const
+    {
+        return fields() < other.fields();
+    }
+};
+
+struct workspace_name_label_t
+{
+    std::shared_ptr<wf::owned_texture_t> texture;
+    wf::dimensions_t size;
+};
+
+/*
+ * Rendered labels, shared by all outputs. Switching workspaces shows labels
+ * which were usually rendered before, so they are only rendered again when
+ * their text or the options change.
+ */
+class workspace_name_cache_t
+{
+    /* Labels which are not shown anywhere are dropped past this count */
+    static const size_t MAX_LABELS = 64;
+    std::map<workspace_name_style_t, workspace_name_label_t> labels;
+
+    static void cairo_set_color(cairo_t *cr, const wf::color_t& color)
+    {
+        cairo_set_source_rgba(cr, color.r, color.g, color.b, color.a);
+    }
+
+    static workspace_name_label_t render(const workspace_name_style_t& style)
+    {
+        const char *name = style.text.c_str();
+        double radius    = style.radius;
+        cairo_text_extents_t text_extents;
+
+        /* Setup dummy context to get the size of the text */
+        cairo_surface_t *cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+        cairo_t *cr = cairo_create(cairo_surface);
+        cairo_select_font_face(cr, style.font.c_str(), CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_size(cr, style.font_size);
+        cairo_text_extents(cr, name, &text_extents);
+        cairo_destroy(cr);
+        cairo_surface_destroy(cairo_surface);
+
+        int x2 = text_extents.width + WIDGET_PADDING * 2;
+        int y2 = text_extents.height + WIDGET_PADDING * 2;
+        cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, x2, y2);
+        cr = cairo_create(cairo_surface);
+        cairo_select_font_face(cr, style.font.c_str(), CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_size(cr, style.font_size);
+
+        cairo_set_color(cr, style.background_color);
+        cairo_new_path(cr);
+        cairo_arc(cr, radius, y2 - radius, radius, M_PI / 2, M_PI);
+        cairo_line_to(cr, 0, radius);
+        cairo_arc(cr, radius, radius, radius, M_PI, 3 * M_PI / 2);
+        cairo_line_to(cr, x2 - radius, 0);
+        cairo_arc(cr, x2 - radius, radius, radius, 3 * M_PI / 2, 2 * M_PI);
+        cairo_line_to(cr, x2, y2 - radius);
+        cairo_arc(cr, x2 - radius, y2 - radius, radius, 0, M_PI / 2);
+        cairo_close_path(cr);
+        cairo_fill(cr);
+
+        cairo_set_color(cr, style.text_color);
+        cairo_move_to(cr,
+            x2 / 2.0 - (text_extents.width / 2 + text_extents.x_bearing),
+            y2 / 2.0 - (text_extents.height / 2 + text_extents.y_bearing));
+        cairo_show_text(cr, name);
+        cairo_stroke(cr);
+
+        workspace_name_label_t label;
+        label.texture = std::make_shared<wf::owned_texture_t>(cairo_surface);
+        label.size    = {x2, y2};
+        cairo_destroy(cr);
+        cairo_surface_destroy(cairo_surface);
+        return label;
+    }
+
+  public:
+    /* Returns the label with the given style, rendering it if needed */
+    workspace_name_label_t get(const workspace_name_style_t& style)
+    {
+        auto it = labels.find(style);
+        if (it != labels.end())
+        {
+            return it->second;
+        }
+
+        if (labels.size() >= MAX_LABELS)
+        {
+            for (auto unused = labels.begin(); unused != labels.end();)
+            {
+                if (unused->second.texture.use_count() == 1)
+                {
+                    unused = labels.erase(unused);
+                } else
+                {
+                    ++unused;
+                }
+            }
+        }
+
+        return labels[style] = render(style);
+    }
 };
 
 namespace wf
@@ -117,8 +239,6 @@ class simple_node_render_instance_t : public render_instance_t
                     OpenGL::render_texture(wf::gles_texture_t{workspace->texture->get_texture()},
                         data.target, g, glm::vec4(1, 1, 1, *alpha_fade), 0);
                 }
-
-                wf::scene::damage_node(self, g);
             });
         }
     }
@@ -171,9 +291,22 @@ class simple_node_t : public node_t
             workspace->rect.width, workspace->rect.height};
     }
 
+    /* Damages the label where it currently is */
+    void damage()
+    {
+        wf::scene::damage_node(this, get_bounding_box());
+    }
+
     void set_offset(wf::point_t offset)
     {
+        if (this->offset == offset)
+        {
+            return;
+        }
+
+        damage();
         this->offset = offset;
+        damage();
     }
 
     wf::point_t get_ws()
@@ -183,7 +316,13 @@ class simple_node_t : public node_t
 
     void set_alpha(double alpha)
     {
+        if (this->alpha_fade == alpha)
+        {
+            return;
+        }
+
         this->alpha_fade = alpha;
+        damage();
     }
 };
 
@@ -199,7 +338,8 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
 {
     wf::wl_timer<false> timer;
     bool hook_set = false;
-    std::vector<std::vector<std::shared_ptr<simple_node_t>>> workspaces;
+    /* Label nodes, only of the workspaces which can currently be seen */
+    std::map<std::pair<int, int>, std::shared_ptr<simple_node_t>> workspaces;
     wf::option_wrapper_t<std::string> font{"workspace-names/font"};
     wf::option_wrapper_t<std::string> position{"workspace-names/position"};
     wf::option_wrapper_t<int> display_duration{"workspace-names/display_duration"};
@@ -213,12 +353,19 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
     wf::option_wrapper_t<bool> show_option_values{"workspace-names/show_option_values"};
     wf::animation::simple_animation_t alpha_fade{display_duration};
     wf::option_wrapper_t<wf::config::compound_list_t<std::string>> workspace_names{"workspace-names/names"};
+    wf::shared_data::ref_ptr_t<workspace_name_cache_t> label_cache;
+    /* Workspace names of this output, by workspace number */
+    std::unordered_map<int, std::string> name_index;
+    /* The per-workspace options of this output, watched for changes */
+    std::vector<std::shared_ptr<wf::config::option_base_t>> workspace_options;
 
   public:
     void init() override
     {
         alpha_fade.set(0, 0);
+        update_name_index();
 
+        wf::get_core().connect(&on_config_reload);
         output->wset()->connect(&workspace_grid_changed);
         output->connect(&workarea_changed);
         output->connect(&viewport_changed);
@@ -229,6 +376,7 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
         text_color.set_callback(option_changed);
         show_option_values.set_callback(option_changed);
         show_option_names.set_callback(show_options_changed);
+        workspace_names.set_callback(names_changed);
 
         if (show_option_names)
         {
@@ -236,39 +384,44 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
         }
     }
 
-    void init_workspace_name_nodes()
+    /*
+     * Makes sure the given workspaces have label nodes and removes the nodes
+     * of all other workspaces, so that only the labels which can be seen are
+     * kept around no matter how large the workspace grid is.
+     */
+    void show_workspace_name_nodes(const std::vector<wf::point_t>& visible)
     {
         auto wsize = output->wset()->get_workspace_grid_size();
-        auto og    = output->get_relative_geometry();
-        workspaces.resize(wsize.width);
-        for (int x = 0; x < wsize.width; x++)
+        decltype(workspaces) shown;
+        for (auto ws : visible)
         {
-            workspaces[x].resize(wsize.height);
-        }
+            if ((ws.x < 0) || (ws.y < 0) || (ws.x >= wsize.width) || (ws.y >= wsize.height))
+            {
+                continue;
+            }
 
-        for (int x = 0; x < wsize.width; x++)
-        {
-            for (int y = 0; y < wsize.height; y++)
+            auto it = workspaces.find({ws.x, ws.y});
+            if (it != workspaces.end())
             {
-                workspaces[x][y] = add_simple_node(output, {int(x * og.width),
-                    int(y * og.height)}, {x, y});
+                shown.insert(workspaces.extract(it));
+            } else if (!shown.count({ws.x, ws.y}))
+            {
+                shown[{ws.x, ws.y}] = add_simple_node(output, {0, 0}, ws);
             }
         }
+
+        fini_workspace_name_nodes();
+        workspaces = std::move(shown);
     }
 
     void fini_workspace_name_nodes()
     {
-        for (auto & x : workspaces)
+        for (auto& [ws, workspace] : workspaces)
         {
-            for (auto & workspace : x)
-            {
-                auto& wsn = workspace->workspace;
-                cairo_surface_destroy(wsn->cairo_surface);
-                cairo_destroy(wsn->cr);
-                wf::scene::remove_child(workspace);
-                workspace.reset();
-            }
+            wf::scene::remove_child(workspace);
         }
+
+        workspaces.clear();
     }
 
     wf::signal::connection_t<wf::workspace_grid_changed_signal> workspace_grid_changed{[this] (wf::
@@ -276,7 +429,10 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
                                                                                                *ev)
         {
             deactivate();
-            init_workspace_name_nodes();
+            if (show_option_names)
+            {
+                update_workspace_names_timeout(output->wset()->get_current_workspace());
+            }
         }
     };
 
@@ -293,132 +449,125 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
             alpha_fade.animate(alpha_fade, 0);
         }
 
-        output->render->damage_whole();
+        output->render->schedule_redraw();
     };
 
-    void update_name(std::shared_ptr<simple_node_t> workspace)
+    /* Returns the number in an option name of the form <prefix><number>, or 0
+     * if the name is not of this form */
+    static int parse_workspace_key(const std::string& name, const std::string& prefix)
     {
-        auto section = wf::get_core().config->get_section("workspace-names");
-        auto wsize   = output->wset()->get_workspace_grid_size();
-        auto wsn     = workspace->workspace;
-        int ws_num   = workspace->get_ws().x + workspace->get_ws().y * wsize.width + 1;
-
-        // Get the option name (key) of the target workspace
-        std::string key = output->to_string() + "_workspace_" + std::to_string(ws_num);
-
-        if (show_option_names && !show_option_values)
-        {
-            wsn->name = key;
-        } else
+        if ((name.size() <= prefix.size()) || name.compare(0, prefix.size(), prefix))
         {
-            bool option_found = false;
-            for (auto option : section->get_registered_options())
-            {
-                int ws;
-                if (sscanf(option->get_name().c_str(), (output->to_string() + "_workspace_%d").c_str(),
-                    &ws) != 1)
-                {
-                    continue;
-                }
+            return 0;
+        }
 
-                if (ws == ws_num)
-                {
-                    wsn->name    = option->get_value_str();
-                    option_found = true;
-                    break;
-                }
-            }
+        char *end;
+        long ws = strtol(name.c_str() + prefix.size(), &end, 10);
+        return (*end == '\0' && ws > 0 && ws <= INT_MAX) ? ws : 0;
+    }
+
+    /*
+     * Collects the names of this output's workspaces from the per-workspace
+     * options and the names list, so that labels do not have to search the
+     * config. Options take precedence over the list.
+     */
+    void update_name_index()
+    {
+        auto section = wf::get_core().config->get_section("workspace-names");
+        std::string prefix = output->to_string() + "_workspace_";
 
-            if (!option_found)
+        unwatch_workspace_options();
+        name_index.clear();
+        for (auto option : section->get_registered_options())
+        {
+            if (int ws = parse_workspace_key(option->get_name(), prefix))
             {
-                for (const auto& [wsid, wsname] : workspace_names.value())
-                {
-                    if (wsid == key)
-                    {
-                        wsn->name    = wsname;
-                        option_found = true;
-                        break;
-                    }
-                }
+                name_index.emplace(ws, option->get_value_str());
+                option->add_updated_handler(&names_changed);
+                workspace_options.push_back(option);
             }
+        }
 
-            if (!option_found)
+        for (const auto& [wsid, wsname] : workspace_names.value())
+        {
+            if (int ws = parse_workspace_key(wsid, prefix))
             {
-                wsn->name = "Workspace " + std::to_string(ws_num);
+                name_index.emplace(ws, wsname);
             }
         }
     }
 
-    void update_names()
+    void unwatch_workspace_options()
     {
-        for (auto & x : workspaces)
+        for (auto& option : workspace_options)
         {
-            for (auto & workspace : x)
-            {
-                update_name(workspace);
-                update_texture(workspace->workspace);
-            }
+            option->rem_updated_handler(&names_changed);
         }
+
+        workspace_options.clear();
     }
 
-    void update_texture(std::shared_ptr<workspace_name> wsn)
+    wf::signal::connection_t<wf::reload_config_signal> on_config_reload = [=] (wf::reload_config_signal *ev)
     {
-        update_texture_position(wsn);
-        render_workspace_name(wsn);
-    }
+        names_changed();
+    };
 
-    void update_textures()
+    wf::config::option_base_t::updated_callback_t names_changed = [=] ()
+    {
+        update_name_index();
+        option_changed();
+    };
+
+    void update_name(std::shared_ptr<simple_node_t> workspace)
     {
         auto wsize = output->wset()->get_workspace_grid_size();
-        for (int x = 0; x < wsize.width; x++)
+        auto wsn   = workspace->workspace;
+        int ws_num = workspace->get_ws().x + workspace->get_ws().y * wsize.width + 1;
+
+        if (show_option_names && !show_option_values)
         {
-            for (int y = 0; y < wsize.height; y++)
+            // Show the option name (key) of the target workspace
+            wsn->name = output->to_string() + "_workspace_" + std::to_string(ws_num);
+        } else
+        {
+            auto it = name_index.find(ws_num);
+            if (it != name_index.end())
+            {
+                wsn->name = it->second;
+            } else
             {
-                update_texture(workspaces[x][y]->workspace);
+                wsn->name = "Workspace " + std::to_string(ws_num);
             }
         }
-
-        output->render->damage_whole();
     }
 
-    void cairo_recreate(std::shared_ptr<workspace_name> wsn)
+    void update_names()
     {
-        auto og = output->get_relative_geometry();
-        auto font_size = og.height * 0.05;
-        cairo_t *cr    = wsn->cr;
-        cairo_surface_t *cairo_surface = wsn->cairo_surface;
-
-        if (!cr)
+        for (auto& [ws, workspace] : workspaces)
         {
-            /* Setup dummy context to get initial font size */
-            cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
-            cr = cairo_create(cairo_surface);
+            update_name(workspace);
+            update_texture(workspace);
         }
+    }
 
-        cairo_select_font_face(cr, std::string(
-            font).c_str(), CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-        cairo_set_font_size(cr, font_size);
-
-        const char *name = wsn->name.c_str();
-        cairo_text_extents(cr, name, &wsn->text_extents);
-
-        wsn->rect.width  = wsn->text_extents.width + WIDGET_PADDING * 2;
-        wsn->rect.height = wsn->text_extents.height + WIDGET_PADDING * 2;
-
-        /* Recreate surface based on font size */
-        cairo_destroy(cr);
-        cairo_surface_destroy(cairo_surface);
-
-        cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-            wsn->rect.width, wsn->rect.height);
-        cr = cairo_create(cairo_surface);
-
-        cairo_select_font_face(cr, std::string(
-            font).c_str(), CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-        cairo_set_font_size(cr, font_size);
+    /* Updates the label of a node, damaging both its old and new area if it
+     * changed */
+    void update_texture(std::shared_ptr<simple_node_t> node)
+    {
+        auto wsn  = node->workspace;
+        auto og   = output->get_relative_geometry();
+        auto rect = wsn->rect;
+        auto label = label_cache->get({wsn->name, font, og.height * 0.05,
+            background_radius, text_color, background_color});
+        if ((label.texture == wsn->texture) && (rect == get_texture_position(label.size)))
+        {
+            return;
+        }
 
-        wsn->cr = cr;
-        wsn->cairo_surface = cairo_surface;
+        node->damage();
+        wsn->texture = label.texture;
+        wsn->rect    = get_texture_position(label.size);
+        node->damage();
     }
 
     wf::config::option_base_t::updated_callback_t option_changed = [=] ()
@@ -426,158 +575,99 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
         if (hook_set)
         {
             update_names();
-            update_textures();
         }
     };
 
-    void update_texture_position(std::shared_ptr<workspace_name> wsn)
+    /* Returns where a label of the given size is shown */
+    wf::geometry_t get_texture_position(wf::dimensions_t size)
     {
         auto workarea = output->workarea->get_workarea();
-
-        cairo_recreate(wsn);
+        wf::geometry_t rect{0, 0, size.width, size.height};
 
         if ((std::string)position == "top_left")
         {
-            wsn->rect.x = workarea.x + margin;
-            wsn->rect.y = workarea.y + margin;
+            rect.x = workarea.x + margin;
+            rect.y = workarea.y + margin;
         } else if ((std::string)position == "top_center")
         {
-            wsn->rect.x = workarea.x + (workarea.width / 2 - wsn->rect.width / 2);
-            wsn->rect.y = workarea.y + margin;
+            rect.x = workarea.x + (workarea.width / 2 - size.width / 2);
+            rect.y = workarea.y + margin;
         } else if ((std::string)position == "top_right")
         {
-            wsn->rect.x = workarea.x + (workarea.width - wsn->rect.width) - margin;
-            wsn->rect.y = workarea.y + margin;
+            rect.x = workarea.x + (workarea.width - size.width) - margin;
+            rect.y = workarea.y + margin;
         } else if ((std::string)position == "center_left")
         {
-            wsn->rect.x = workarea.x + margin;
-            wsn->rect.y = workarea.y + (workarea.height / 2 - wsn->rect.height / 2);
+            rect.x = workarea.x + margin;
+            rect.y = workarea.y + (workarea.height / 2 - size.height / 2);
         } else if ((std::string)position == "center")
         {
-            wsn->rect.x = workarea.x + (workarea.width / 2 - wsn->rect.width / 2);
-            wsn->rect.y = workarea.y + (workarea.height / 2 - wsn->rect.height / 2);
+            rect.x = workarea.x + (workarea.width / 2 - size.width / 2);
+            rect.y = workarea.y + (workarea.height / 2 - size.height / 2);
         } else if ((std::string)position == "center_right")
         {
-            wsn->rect.x = workarea.x + (workarea.width - wsn->rect.width) - margin;
-            wsn->rect.y = workarea.y + (workarea.height / 2 - wsn->rect.height / 2);
+            rect.x = workarea.x + (workarea.width - size.width) - margin;
+            rect.y = workarea.y + (workarea.height / 2 - size.height / 2);
         } else if ((std::string)position == "bottom_left")
         {
-            wsn->rect.x = workarea.x + margin;
-            wsn->rect.y = workarea.y + (workarea.height - wsn->rect.height) - margin;
+            rect.x = workarea.x + margin;
+            rect.y = workarea.y + (workarea.height - size.height) - margin;
         } else if ((std::string)position == "bottom_center")
         {
-            wsn->rect.x = workarea.x + (workarea.width / 2 - wsn->rect.width / 2);
-            wsn->rect.y = workarea.y + (workarea.height - wsn->rect.height) - margin;
+            rect.x = workarea.x + (workarea.width / 2 - size.width / 2);
+            rect.y = workarea.y + (workarea.height - size.height) - margin;
         } else if ((std::string)position == "bottom_right")
         {
-            wsn->rect.x = workarea.x + (workarea.width - wsn->rect.width) - margin;
-            wsn->rect.y = workarea.y + (workarea.height - wsn->rect.height) - margin;
+            rect.x = workarea.x + (workarea.width - size.width) - margin;
+            rect.y = workarea.y + (workarea.height - size.height) - margin;
         } else
         {
-            wsn->rect.x = workarea.x;
-            wsn->rect.y = workarea.y;
+            rect.x = workarea.x;
+            rect.y = workarea.y;
         }
+
+        return rect;
     }
 
     wf::signal::connection_t<wf::workarea_changed_signal> workarea_changed{[this] (wf::workarea_changed_signal
                                                                                    *ev)
         {
-            update_workspace_names_timeout();
-            update_textures();
+            update_workspace_names_timeout(output->wset()->get_current_workspace());
         }
     };
 
-    void cairo_clear(cairo_t *cr)
-    {
-        cairo_set_source_rgba(cr, 0, 0, 0, 0);
-        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-        cairo_paint(cr);
-    }
-
-    void render_workspace_name(std::shared_ptr<workspace_name> wsn)
-    {
-        double xc = wsn->rect.width / 2.0;
-        double yc = wsn->rect.height / 2.0;
-        int x2, y2;
-        const char *name = wsn->name.c_str();
-        double radius = background_radius;
-        cairo_t *cr   = wsn->cr;
-
-        cairo_clear(cr);
-
-        x2 = wsn->rect.width;
-        y2 = wsn->rect.height;
-
-        cairo_set_source_rgba(cr,
-            wf::color_t(background_color).r,
-            wf::color_t(background_color).g,
-            wf::color_t(background_color).b,
-            wf::color_t(background_color).a);
-        cairo_new_path(cr);
-        cairo_arc(cr, radius, y2 - radius, radius, M_PI / 2, M_PI);
-        cairo_line_to(cr, 0, radius);
-        cairo_arc(cr, radius, radius, radius, M_PI, 3 * M_PI / 2);
-        cairo_line_to(cr, x2 - radius, 0);
-        cairo_arc(cr, x2 - radius, radius, radius, 3 * M_PI / 2, 2 * M_PI);
-        cairo_line_to(cr, x2, y2 - radius);
-        cairo_arc(cr, x2 - radius, y2 - radius, radius, 0, M_PI / 2);
-        cairo_close_path(cr);
-        cairo_fill(cr);
-
-        cairo_set_source_rgba(cr,
-            wf::color_t(text_color).r,
-            wf::color_t(text_color).g,
-            wf::color_t(text_color).b,
-            wf::color_t(text_color).a);
-        cairo_text_extents(cr, name, &wsn->text_extents);
-        cairo_move_to(cr,
-            xc - (wsn->text_extents.width / 2 + wsn->text_extents.x_bearing),
-            yc - (wsn->text_extents.height / 2 + wsn->text_extents.y_bearing));
-        cairo_show_text(cr, name);
-        cairo_stroke(cr);
-
-        wsn->texture = std::make_unique<wf::owned_texture_t>(wsn->cairo_surface);
-    }
-
     void set_alpha()
     {
-        auto wsize = output->wset()->get_workspace_grid_size();
-        for (int x = 0; x < wsize.width; x++)
+        for (auto& [ws, workspace] : workspaces)
         {
-            for (int y = 0; y < wsize.height; y++)
-            {
-                workspaces[x][y]->set_alpha(alpha_fade);
-            }
+            workspace->set_alpha(alpha_fade);
         }
     }
 
+    /* Labels only damage themselves when their alpha actually changes, so
+     * nothing is repainted once the fade is done. */
     wf::effect_hook_t pre_hook = [=] ()
     {
-        if (alpha_fade.running())
-        {
-            set_alpha();
-        }
+        set_alpha();
     };
 
-    void update_workspace_names_timeout()
+    /* Shows the labels of the current workspace and of target, which is the
+     * workspace being switched to */
+    void update_workspace_names_timeout(wf::point_t target)
     {
-        auto wsize = output->wset()->get_workspace_grid_size();
-        auto nvp   = output->wset()->get_current_workspace();
-        auto og    = output->get_relative_geometry();
+        auto nvp = output->wset()->get_current_workspace();
+        auto og  = output->get_relative_geometry();
 
         activate();
-        update_textures();
-        update_names();
-
-        for (int x = 0; x < wsize.width; x++)
+        show_workspace_name_nodes({nvp, target});
+        for (auto& [ws, workspace] : workspaces)
         {
-            for (int y = 0; y < wsize.height; y++)
-            {
-                workspaces[x][y]->set_offset({int((x - nvp.x) * og.width), int((y - nvp.y) * og.height)});
-            }
+            workspace->set_offset({int((ws.first - nvp.x) * og.width), int((ws.second - nvp.y) * og.height)});
         }
 
-        output->render->damage_whole();
+        update_names();
+
+        output->render->schedule_redraw();
 
         if (show_option_names)
         {
@@ -595,7 +685,7 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
                                                                                                   *
                                                                                                   ev)
         {
-            update_workspace_names_timeout();
+            update_workspace_names_timeout(ev->new_viewport);
         }
     };
 
@@ -603,14 +693,15 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
                                                                                     workspace_changed_signal*
                                                                                     ev)
         {
-            update_workspace_names_timeout();
+            update_workspace_names_timeout(ev ? ev->new_viewport :
+                output->wset()->get_current_workspace());
         }
     };
 
     wf::wl_timer<false>::callback_t timeout = [=] ()
     {
-        output->render->damage_whole();
         alpha_fade.animate(alpha_fade, 0);
+        output->render->schedule_redraw();
     };
 
     wf::effect_hook_t post_hook = [=] ()
@@ -618,9 +709,9 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
         if (!alpha_fade.running() && !timer.is_connected() && !show_option_names)
         {
             deactivate();
-        } else
+        } else if (alpha_fade.running())
         {
-            set_alpha();
+            output->render->schedule_redraw();
         }
     };
 
@@ -631,7 +722,6 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
             return;
         }
 
-        init_workspace_name_nodes();
         output->render->add_effect(&post_hook, wf::OUTPUT_EFFECT_POST);
         output->render->add_effect(&pre_hook, wf::OUTPUT_EFFECT_PRE);
         output->render->damage_whole();
@@ -659,6 +749,8 @@ class wayfire_workspace_names_output : public wf::per_output_plugin_instance_t
         viewport_change_request.disconnect();
         viewport_changed.disconnect();
         workarea_changed.disconnect();
+        on_config_reload.disconnect();
+        unwatch_workspace_options();
 
         output->render->damage_whole();
     }